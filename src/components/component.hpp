@@ -44,6 +44,9 @@ using Locations = std::vector<Location>;
 using RenderPos = std::pair<float, float>;
 using Field = std::pair<Location, Location>;
 using Path = std::deque<Location>;
+//index of a compressed path in the router's PathPool
+using PathHandle = int;
+const PathHandle NO_PATH = -1;
 
 enum EntityType {
     CHARACTER,
@@ -67,6 +70,8 @@ enum TaskType {
     OBTAIN, //near storage
     EMPTY
 };
+//EMPTY stays last, so this is the number of task types
+const int TASK_TYPE_COUNT = EMPTY + 1;
 
 enum ActionType {
     CHOP,   //chop tree marked(has target component)
@@ -94,7 +99,7 @@ struct Task {
     bool finished;
     int id;
     Entity actor = -1;
-    void print_task_info() {
+    void print_task_info() const {
         std::cout << "--------------------------------" << std::endl;
         std::cout << "task id: " << id << ", type: " << static_cast<int>(type) << ", target locations: " << target_locations[0].x << ", " << target_locations[0].y << std::endl;
         std::cout << "target action: " << static_cast<int>(target_action.type) << ", act on: " << target_action.target_entity << std::endl;
@@ -113,9 +118,14 @@ struct MovementComponent {
     float progress; 
     float speed;    
     bool move_finished;
-    Path path;
+    PathHandle path = NO_PATH;
+    //state at the end of the previous tick, drawing interpolates from it. prev_progress < 0 until there is one
+    Location prev_start_pos = {};
+    Location prev_end_pos = {};
+    float prev_progress = -1;
 };
 
+//a stack of loose resources on one tile, amount is the number of woods
 struct ResourceComponent {
     int amount;
     Entity holder;
@@ -138,11 +148,10 @@ struct CreateComponent {
     EntityType entity_type;
 };
 
-//5 woods in one pack
+//woods held by a character, storage unit or blueprint, as a count
 struct StorageComponent {
     int storage_capacity;
     int current_storage;
-    std::deque<Entity> stored_resources;
 };
 
 //character will have this
@@ -160,6 +169,15 @@ struct ActionComponent {
     bool in_progress;
 };
     
+//per character work tab: for each task type 1 (do first) .. WORK_PRIORITY_LOWEST, or disabled
+#define WORK_DISABLED 0
+#define WORK_PRIORITY_HIGHEST 1
+#define WORK_PRIORITY_LOWEST 4
+#define WORK_PRIORITY_DEFAULT 3
+struct WorkPriorityComponent {
+    std::array<int, TASK_TYPE_COUNT> priority;
+};
+
 //used to track task and progress
 struct TargetComponent {
     float progress;
@@ -220,10 +238,12 @@ NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ConstructionComponent, allocated, is_built)
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(CreateComponent, to_be_created, amount, entity_type)
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(StorageComponent, storage_capacity, current_storage, stored_resources)
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(StorageComponent, storage_capacity, current_storage)
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(TaskComponent, current_task)
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ActionComponent, current_action, action_finished, in_progress)
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(TargetComponent, progress, timer, is_target, is_finished, to_be_deleted, hold_by)
\ No newline at end of file
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(TargetComponent, progress, timer, is_target, is_finished, to_be_deleted, hold_by)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(WorkPriorityComponent, priority)
\ No newline at end of file
@@ -5,6 +5,18 @@
 #include <memory>
 #include <cassert>
 #include <iostream>
+#include <bitset>
+
+using ComponentMask = std::bitset<MAX_COMPONENTS>;
+
+//debug builds: while a scheduled system runs, the component types it declared.
+//any other access is reported once per type
+struct AccessScope {
+    const char* system;
+    ComponentMask allowed;
+    ComponentMask reported;
+    int violations = 0;
+};
 
 class ComponentManager {
 public:
@@ -23,27 +35,43 @@ public:
     }
 
     template<typename T>
-    ComponentType get_component_type() {
-        std::type_index type_name = typeid(T);
-        assert(component_types.find(type_name) != component_types.end() && "Component not registered before use.");
-        return component_types[type_name];
+    ComponentType get_component_type() const {
+        auto it = component_types.find(typeid(T));
+        assert(it != component_types.end() && "Component not registered before use.");
+        return it->second;
+    }
+
+    //mask with the bits of the given component types
+    template<typename... Ts>
+    ComponentMask component_mask() const {
+        ComponentMask mask;
+        (mask.set(get_component_type<Ts>()), ...);
+        return mask;
     }
 
     template<typename T>
     void add_component(Entity entity, T component) {
+        check_access<T>();
         get_component_array<T>()->insert_data(entity, component);
     }
 
     template<typename T>
     void remove_component(Entity entity) {
+        check_access<T>();
         get_component_array<T>()->remove_data(entity);
     }
 
     template<typename T>
     T& get_component(Entity entity) {
+        check_access<T>();
         return get_component_array<T>()->get_data(entity);
     }
 
+    //set by the system scheduler around each system, per thread
+    static void set_access_scope(AccessScope* scope) {
+        access_scope_ = scope;
+    }
+
     void entity_destroy(Entity entity) {
         for (auto const& pair : component_arrays) {
             auto const& component = pair.second;
@@ -61,6 +89,7 @@ public:
 
     template<typename T>
     bool has_component(Entity entity) {
+        check_access<T>();
         return get_component_array<T>()->has_data(entity);
     }
 
@@ -82,11 +111,29 @@ private:
     std::unordered_map<std::type_index, ComponentType> component_types{};
     std::unordered_map<std::type_index, std::shared_ptr<IComponentArray>> component_arrays{};
     ComponentType next_component_type{1};
+    static inline thread_local AccessScope* access_scope_ = nullptr;
 
+    //lookups only, so systems on different threads can share the manager
     template<typename T>
     std::shared_ptr<ComponentArray<T>> get_component_array() {
-        std::type_index type_name = typeid(T);
-        assert(component_types.find(type_name) != component_types.end() && "Component not registered before use.");
-        return std::static_pointer_cast<ComponentArray<T>>(component_arrays[type_name]);
+        auto it = component_arrays.find(typeid(T));
+        assert(it != component_arrays.end() && "Component not registered before use.");
+        return std::static_pointer_cast<ComponentArray<T>>(it->second);
+    }
+
+    template<typename T>
+    void check_access() {
+#ifndef NDEBUG
+        if (!access_scope_)
+            return;
+        auto type = get_component_type<T>();
+        if (access_scope_->allowed[type])
+            return;
+        ++access_scope_->violations;
+        if (!access_scope_->reported[type]) {
+            access_scope_->reported.set(type);
+            std::cout << "undeclared access: system " << access_scope_->system << " uses " << typeid(T).name() << std::endl;
+        }
+#endif
     }
 };
\ No newline at end of file
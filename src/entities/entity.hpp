@@ -2,6 +2,7 @@
 #include "../components/componentManager.hpp"
 #include <queue>
 #include <bitset>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
@@ -20,6 +21,8 @@ public:
         available_entities.pop();
         ++living_entity_count;
         entity_used.set(id);
+        entity_awake.set(id);
+        unsettled.push_back(id);
         max_entity_id = std::max(max_entity_id, id);
         std::cout << "Entity " << id << " created" << std::endl;
         return id;
@@ -29,6 +32,7 @@ public:
         available_entities.push(entity);
         --living_entity_count;
         entity_used.reset(entity);
+        entity_awake.reset(entity);
     }
 
     Entities get_all_entities() const {
@@ -49,6 +53,50 @@ public:
         return entity_used.test(entity);
     }
 
+    //a sleeping entity is alive but left out of get_awake_entities, which the systems walk
+    //every tick. new and loaded entities are awake, wake() one whenever something happens to it
+    void sleep(Entity entity) {
+        entity_awake.reset(entity);
+    }
+
+    void wake(Entity entity) {
+        if (entity >= 0 && entity < MAX_ENTITIES && entity_used.test(entity) && !entity_awake.test(entity)) {
+            entity_awake.set(entity);
+            unsettled.push_back(entity);
+        }
+    }
+
+    //entities created or woken since the last call, each once. whoever checks them puts
+    //back with keep_unsettled() the ones that can not sleep yet, the rest stay awake for good
+    Entities take_unsettled() {
+        Entities entities;
+        entities.swap(unsettled);
+        std::sort(entities.begin(), entities.end());
+        entities.erase(std::unique(entities.begin(), entities.end()), entities.end());
+        return entities;
+    }
+
+    void keep_unsettled(Entity entity) {
+        unsettled.push_back(entity);
+    }
+
+    bool is_awake(Entity entity) const {
+        return entity_awake.test(entity);
+    }
+
+    Entities get_awake_entities() const {
+        Entities entities;
+        for (int i = 0; i <= max_entity_id; ++i) {
+            if (entity_awake.test(i))
+                entities.emplace_back(i);
+        }
+        return entities;
+    }
+
+    size_t awake_count() const {
+        return entity_awake.count();
+    }
+
     void save() const {
         std::string filename = "../saves/entities.json";
         nlohmann::json j;
@@ -86,6 +134,7 @@ public:
             available_entities.pop();
         living_entity_count = 0;
         entity_used.reset();
+        entity_awake.reset();
 
         if (j.contains("active_entities")) {
             for (const auto& id : j["active_entities"]) {
@@ -103,6 +152,8 @@ public:
                 available_entities.push(i);
             }
         }
+        entity_awake = entity_used;
+        unsettled = get_all_entities();
     }
 
 private:
@@ -110,5 +161,7 @@ private:
     std::uint32_t living_entity_count{0};
     std::queue<Entity> available_entities;
     std::bitset<MAX_ENTITIES> entity_used;
+    std::bitset<MAX_ENTITIES> entity_awake;
+    Entities unsettled;
     int max_entity_id{0};
 };
@@ -1,9 +1,24 @@
 #include <iostream>
 #include "ui/ui.hpp"
 #include <sstream>
-int main() {
+#include <string>
+int main(int argc, char** argv) {
     std::cout << "Game initializing..." << std::endl;
 
+    //--threads N: worker threads for the simulation, 1 runs everything in order for debugging
+    //--seed N: seed of new worlds, the same seed and commands play out the same with any thread count
+    //--compare-heuristics: also count the nodes manhattan-only A* would expand, slow
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--compare-heuristics")
+            Router::set_compare_heuristics(true);
+        if (i + 1 >= argc)
+            break;
+        if (std::string(argv[i]) == "--threads")
+            JobSystem::set_default_threads(std::atoi(argv[i + 1]));
+        else if (std::string(argv[i]) == "--seed")
+            RandomSource::set_default_seed(std::strtoull(argv[i + 1], nullptr, 10));
+    }
+
     bool is_fullscreen = true;
     int custom_width = 1280, custom_height = 720;
     
@@ -1,21 +1,35 @@
 #pragma once
 #include "utils/path.hpp"
+#include "utils/pathScheduler.hpp"
+#include "utils/jobSystem.hpp"
 #include <cassert>
+#include <cmath>
 class ActionSystem {
     static constexpr float BASE_MOVE_SPEED = 2.0f; 
     static constexpr float DOG_SPEED_MULTIPLIER = 1.5f;  
     static constexpr float HAS_TASK_BOOSTER = 2.0f;
+    static constexpr int WOODS_PER_TREE = 55;
+    //animals further than this (manhattan) from every character think on one tick in ANIMAL_LOD_PERIOD
+    static constexpr int ANIMAL_LOD_DISTANCE = 20;
+    static constexpr int ANIMAL_LOD_PERIOD = 4;
     ComponentManager& component_manager_;
     EntityManager& entity_manager_;
     Router& router_;
+    JobSystem& jobs_;
+    PathScheduler scheduler_;
     int map_size_;
     int framerate_;
+    int wood_hauled_ = 0; //woods placed into storage, for throughput stats
+    int store_trips_ = 0; //times a character emptied its bag into storage
+    bool animal_lod_ = true;
 public:
     ActionSystem();
-    ActionSystem(ComponentManager& component_manager, EntityManager& entity_manager, Router& router, int map_size, int framerate) 
+    ActionSystem(ComponentManager& component_manager, EntityManager& entity_manager, Router& router, JobSystem& jobs, int map_size, int framerate) 
         : component_manager_(component_manager), 
           entity_manager_(entity_manager), 
           router_(router), 
+          jobs_(jobs),
+          scheduler_(router),
           map_size_(map_size),
           framerate_(framerate) {
         std::cout << "ActionSystem initialized" << std::endl;
@@ -24,11 +38,19 @@ public:
     void update()  {
         bool print = true;
         std::cout << "try update action" << std::endl;
-        auto entities = router_.get_entities_with_components<TaskComponent>();
-        
-        for (auto entity : entities) {
-            auto& type = component_manager_.get_component<RenderComponent>(entity).entityType;
-            if (type == EntityType::DOG) 
+        auto entities = router_.get_awake_entities_with_components<TaskComponent>();
+        Locations characters;
+        if (animal_lod_)
+            for (auto character : router_.get_characters())
+                characters.push_back(component_manager_.get_component<LocationComponent>(character).loc);
+
+        //collidable movers (dogs) decide and move in the serial merge instead, one after another in
+        //entity order as before the parallel pass, so each sees the tiles taken before it this tick
+        //and two of them can't step onto the same tile
+        std::vector<char> deferred(entities.size(), 0);
+        for (size_t i = 0; i < entities.size(); ++i) {
+            auto entity = entities[i];
+            if (component_manager_.get_component<RenderComponent>(entity).entityType == EntityType::DOG)
                 print = false;
 
             if (!component_manager_.has_component<ActionComponent>(entity)) {
@@ -39,15 +61,81 @@ public:
                 });
             }
 
-            auto& action = component_manager_.get_component<ActionComponent>(entity);
-            auto& task = component_manager_.get_component<TaskComponent>(entity);
+            if (component_manager_.get_component<RenderComponent>(entity).collidable) {
+                deferred[i] = 1;
+                continue;
+            }
+            prepare_action(entity, characters, print);
+        }
+
+        //parallel pass: movement, interpolation state and waiting on action timers only touch the
+        //entity's own components and read the collision map, built once here.
+        //none of these movers is collidable, so none of them changes what the others check
+        router_.update_collision();
+        std::vector<char> serial(entities.size(), 0);
+        jobs_.parallel_for(0, static_cast<int>(entities.size()), [&](int first, int last) {
+            for (int i = first; i < last; ++i)
+                serial[i] = deferred[i] || !execute_local_action(entities[i]);
+        });
+        //a mover standing on a tile may hide or show what else is there
+        router_.invalidate_collision();
+
+        //serial merge, in entity order: chop, build, pick and place move wood between entities,
+        //spawn entities and change router state, collidable movers take their step
+        print = true;
+        for (size_t i = 0; i < entities.size(); ++i) {
+            auto entity = entities[i];
+            if (component_manager_.get_component<RenderComponent>(entity).entityType == EntityType::DOG)
+                print = false;
+            if (deferred[i]) {
+                prepare_action(entity, characters, print);
+                if (execute_local_action(entity))
+                    continue;
+            }
+            if (serial[i])
+                execute_current_action(entity, print);
+        }
+
+        //searches requested this tick (and left over from earlier ones) run within the budget
+        scheduler_.update();
+    }
 
-            if (print) router_.print_character_current_task(entity);
+    int get_wood_hauled() const {
+        return wood_hauled_;
+    }
 
-            assign_action(entity, print);
+    int get_store_trips() const {
+        return store_trips_;
+    }
 
-            execute_current_action(entity, print);
-        }
+    PathScheduler& get_path_scheduler() {
+        return scheduler_;
+    }
+
+    //distance level of detail for animals, on by default
+    void set_animal_lod(bool on) {
+        animal_lod_ = on;
+    }
+
+    //progress of a chop or build, for drawing. target.progress is only written when a timer stops
+    float get_progress(const TargetComponent& track) const {
+        if (track.hold_by == -1)
+            return track.progress;
+        return track.progress + (100 - track.progress) * router_.get_timers().elapsed(track.hold_by, TimerTag::ACTION_DONE);
+    }
+
+    //before saving: timers are not saved, so running chops and builds write their progress
+    //into the targets and start again from there on the next tick
+    void pause_timed_actions() {
+        for (auto entity : router_.get_timers().scheduled(TimerTag::ACTION_DONE))
+            stop_timed_action(entity);
+    }
+
+    //after loading: timers of the old world belong to nobody
+    void drop_timed_actions() {
+        auto& timers = router_.get_timers();
+        for (auto entity : timers.scheduled(TimerTag::ACTION_DONE))
+            timers.cancel(entity, TimerTag::ACTION_DONE);
     }
 
 private:
@@ -65,8 +153,16 @@ private:
         //isolately deal with idle task
         if (task.type == TaskType::IDLE && router_.is_move_finished(entity)) {
             if (print) std::cout << "assign idle action to this entity " << entity << std::endl;
+            scheduler_.cancel(entity);
+            stop_timed_action(entity);
             action.current_action = wander(entity);
             action.action_finished = false;
+            //wanderers hold the tiles they are stepping between, so planners route around them
+            auto& reservations = router_.get_reservations();
+            int now = reservations.now();
+            reservations.release(entity);
+            reservations.reserve(entity, cur_pos, now, now + ticks_per_step(entity));
+            reservations.reserve(entity, action.current_action.target_location, now, now + ticks_per_step(entity));
             return;
         } else if (task.type == TaskType::IDLE) {
             return;
@@ -89,8 +185,10 @@ private:
                 //IMPORTANT, if one arrives at task location, remember to delete his path
                 if (component_manager_.has_component<MovementComponent>(entity)) {
                     auto& path = component_manager_.get_component<MovementComponent>(entity).path;
-                    path = {};
+                    router_.get_paths().release(path);
                 }
+                scheduler_.cancel(entity);
+                router_.get_reservations().release(entity);
             } else {
                 if (print) std::cout << "entity is in action, skip. Action Target: " << action.current_action.target_entity << std::endl;
             }
@@ -111,52 +209,116 @@ private:
             //move
             if (print) std::cout << "entity " << entity << " current action is move" << std::endl;
             //Here use a trick, do not update path if the next position is always valid
-            //thus should store Path in the move action
+            //thus should store Path in the move component (as a handle into the path pool)
             assert( component_manager_.has_component<MovementComponent>(entity) );
             auto& path = component_manager_.get_component<MovementComponent>(entity).path;
-            //if don't has a path, add one
-            if (path.size() == 0) {
-                path = router_.find_path_to_locations(cur_pos, target_pos, "Ax");
+            auto& paths = router_.get_paths();
+            //paths come from the scheduler, a search may take a few ticks to finish
+            //reservations only cover a window, ask for a new path before running out
+            auto& reservations = router_.get_reservations();
+            Path planned;
+            bool fresh = false;
+            if (scheduler_.poll(entity, cur_pos, target_pos, planned)) {
+                if (planned.empty()) {
+                    std::cout << "no path to target location, set task unfeasible" << std::endl;
+                    paths.release(path);
+                    reservations.release(entity);
+                    task.feasible = false;
+                    return;
+                }
+                adopt_path(entity, cur_pos, planned, path);
+                fresh = true;
                 std::cout << "set a new path" << std::endl;
             }
+
+            if (paths.empty(path)) {
+                if (!scheduler_.is_pending(entity)) {
+                    scheduler_.submit(entity, cur_pos, target_pos, ticks_per_step(entity));
+                    std::cout << "request a new path" << std::endl;
+                }
+                return;
+            } else if (reservations.reserved_until(entity) - reservations.now() < COOP_WINDOW / 2
+                && !scheduler_.is_pending(entity)) {
+                scheduler_.submit(entity, cur_pos, target_pos, ticks_per_step(entity));
+                std::cout << "reservation window ends, request path refresh" << std::endl;
+            } else if (paths.is_truncated(path) && paths.size(path) <= PATH_REPLAN_TILES
+                && !scheduler_.is_pending(entity)) {
+                scheduler_.submit(entity, cur_pos, target_pos, ticks_per_step(entity));
+                std::cout << "path was cut at " << PATH_MAX_WAYPOINTS << " waypoints, request the rest" << std::endl;
+            }
             
             std::cout << "current pos: " << cur_pos.x << ", " << cur_pos.y << std::endl;
 
             //check if next step is valid
-            auto& next_step = path.front();            
+            Location next_step = paths.front(path);
             std::cout << "next step at ( " << next_step.x << ", " << next_step.y << " )" << std::endl;
 
             if (next_step == cur_pos) {
                 std::cout << "already in!" << std::endl;
-                path.pop_front();
+                paths.pop_front(path);
                 return;
             }
 
             if (!router_.is_valid_position(next_step)) {
+                //a path that was just planned is blocked already, set this task unfeasible
+                if (fresh) {
+                    std::cout << "still, next step is invalid, set task unfeasible" << std::endl;
+                    paths.release(path);
+                    reservations.release(entity);
+                    task.feasible = false;
+                    return;
+                }
                 std::cout << "next step invalid, re-calculate path" << std::endl;
-                path = router_.find_path_to_locations(cur_pos, target_pos, "Ax");
-            }
-
-            //still invalid next step, set this task unfeasible
-            if (!router_.is_valid_position(next_step)){
-                std::cout << "still, next step is invalid, set task unfeasible" << std::endl;
-                path = {};
-                task.feasible = false;
+                paths.release(path);
+                scheduler_.submit(entity, cur_pos, target_pos, ticks_per_step(entity));
                 return;
             }
 
             //i do this to decrease the calculation time of routing which costs a lot
-            action.current_action = move_action(entity, path);
+            action.current_action = move_action(entity, paths.front(path));
             action.action_finished = false;
         }
     }
     
+    //the part of an entity's action that can run next to other entities' in the parallel pass:
+    //it writes only this entity's components and reads nothing the pass writes.
+    //false if the action has work that must run in the serial merge
+    bool execute_local_action(Entity entity) {
+        if (component_manager_.has_component<MovementComponent>(entity)) {
+            auto& movement = component_manager_.get_component<MovementComponent>(entity);
+            movement.prev_start_pos = movement.start_pos;
+            movement.prev_end_pos = movement.end_pos;
+            movement.prev_progress = movement.progress;
+        }
+        auto& action = component_manager_.get_component<ActionComponent>(entity);
+        auto& current_action = action.current_action;
+        action.in_progress = true;
+        action.action_finished = false;
+        if (current_action.type == ActionType::MOVE) {
+            move(entity);
+            return true;
+        }
+        if (current_action.type == ActionType::NONE)
+            return true;
+        //a chop or build whose timer is still running has nothing to do this tick
+        if ((current_action.type == ActionType::CHOP || current_action.type == ActionType::BUILD)
+            && router_.get_timers().is_scheduled(entity, TimerTag::ACTION_DONE)) {
+            Entity target = current_action.target_entity;
+            return component_manager_.has_component<TargetComponent>(target)
+                && (current_action.type == ActionType::BUILD || component_manager_.get_component<TargetComponent>(target).is_target);
+        }
+        return false;
+    }
+
     void execute_current_action(Entity entity, bool print) {
         if (print) std::cout << "entity " << entity << " execute current action" << std::endl;
         auto& action = component_manager_.get_component<ActionComponent>(entity);
         auto& current_action = action.current_action;
         action.in_progress = true;
         action.action_finished = false;
+        //what the action works on is touched, it may have something to do again
+        if (current_action.type != ActionType::MOVE)
+            entity_manager_.wake(current_action.target_entity);
         if (current_action.type == ActionType::MOVE) {
             move(entity);
         }
@@ -174,6 +336,58 @@ private:
         }
     }
 
+    //pick this tick's action. serial, it may add components and change router state
+    void prepare_action(Entity entity, const Locations& characters, bool print) {
+        //a far animal keeps walking the step it is on, but only picks the next one on its turn
+        auto& type = component_manager_.get_component<RenderComponent>(entity).entityType;
+        if (type == EntityType::DOG && animal_lod_ && is_far_from(entity, characters)
+            && !router_.get_timers().on_turn(entity, ANIMAL_LOD_PERIOD))
+            return;
+
+        if (print) router_.print_character_current_task(entity);
+
+        assign_action(entity, print);
+
+        //components are only added here, the parallel pass can't
+        auto& action = component_manager_.get_component<ActionComponent>(entity).current_action;
+        if (action.type == ActionType::MOVE && !component_manager_.has_component<MovementComponent>(entity))
+            add_movement(entity);
+    }
+
+    bool is_far_from(Entity entity, const Locations& locations) {
+        auto& loc = component_manager_.get_component<LocationComponent>(entity).loc;
+        for (auto& other : locations)
+            if (router_.calculate_distance(loc, other) <= ANIMAL_LOD_DISTANCE)
+                return false;
+        return true;
+    }
+
+    //reserve a planned route so other planners avoid it, and store it in the pool
+    //the old path (if any) is given back to the pool first
+    void adopt_path(Entity entity, const Location& cur_pos, const Path& path, PathHandle& handle) {
+        router_.reserve_path(entity, cur_pos, path, ticks_per_step(entity));
+        auto& paths = router_.get_paths();
+        paths.release(handle);
+        handle = paths.acquire(cur_pos, path);
+    }
+
+    //estimated ticks to cross one tile: ticks moving plus one tick to finish the move action
+    //and one tick to pop the reached step from the path
+    int ticks_per_step(Entity entity) {
+        float speed = BASE_MOVE_SPEED;
+        auto& type = component_manager_.get_component<RenderComponent>(entity).entityType;
+        if (type == EntityType::DOG)
+            speed *= DOG_SPEED_MULTIPLIER;
+        if (type == EntityType::CHARACTER && !is_character_idle(entity))
+            speed *= HAS_TASK_BOOSTER;
+        return static_cast<int>(std::ceil(framerate_ / speed)) + 2;
+    }
+
+    bool is_character_idle(Entity entity) {
+        return !component_manager_.has_component<TaskComponent>(entity)
+            || component_manager_.get_component<TaskComponent>(entity).current_task.type == TaskType::IDLE;
+    }
+
     //doing nothing(different from idle task)
     bool is_character_available(Entity entity) {
         if (!component_manager_.has_component<ActionComponent>(entity)) {
@@ -185,6 +399,48 @@ private:
         return action.current_action.type == ActionType::NONE || task.current_task.type == TaskType::IDLE;
     }
 
+    //chop and build wait on an ACTION_DONE timer instead of adding progress every tick.
+    //true on the tick the action is done. while the timer runs, hold_by is the actor
+    //and track.progress is what was done before it started
+    bool timed_action_done(Entity entity, TargetComponent& track, float duration) {
+        auto& timers = router_.get_timers();
+        if (track.hold_by == entity) {
+            if (timers.is_scheduled(entity, TimerTag::ACTION_DONE))
+                return false;
+            track.progress = 100;
+            track.hold_by = -1;
+            return true;
+        }
+        //someone else left it half done
+        if (track.hold_by != -1)
+            stop_timed_action(track.hold_by);
+        //as many ticks as adding 100 / (duration * framerate) per tick, this one included
+        int ticks = static_cast<int>(std::ceil((100 - track.progress) * duration * framerate_ / 100));
+        if (ticks <= 1) {
+            track.progress = 100;
+            return true;
+        }
+        track.hold_by = entity;
+        timers.schedule(entity, TimerTag::ACTION_DONE, ticks - 1);
+        std::cout << "entity " << entity << " done in " << ticks << " ticks" << std::endl;
+        return false;
+    }
+
+    //actor left its chop or build, keep the progress so far
+    void stop_timed_action(Entity entity) {
+        auto& timers = router_.get_timers();
+        Entity target = component_manager_.has_component<ActionComponent>(entity)
+            ? component_manager_.get_component<ActionComponent>(entity).current_action.target_entity : -1;
+        if (target != -1 && component_manager_.has_component<TargetComponent>(target)) {
+            auto& track = component_manager_.get_component<TargetComponent>(target);
+            if (track.hold_by == entity) {
+                track.progress = get_progress(track);
+                track.hold_by = -1;
+            }
+        }
+        timers.cancel(entity, TimerTag::ACTION_DONE);
+    }
+
     void finish_current_action(Entity entity) {
         bool process_move = false;
         std::cout << "entity " << entity << " finishes action" << std::endl;
@@ -194,6 +450,10 @@ private:
         //how can an entity without task component finish an action?
         assert(component_manager_.has_component<TaskComponent>(entity));
         auto& task = component_manager_.get_component<TaskComponent>(entity);
+        //the target was chopped, emptied, filled or built, so its neighbours wake up as well
+        Entity target = action.current_action.target_entity;
+        if (action.current_action.type != ActionType::MOVE && component_manager_.has_component<LocationComponent>(target))
+            router_.wake_around(component_manager_.get_component<LocationComponent>(target).loc);
          //if during a task, entity finishes move action,
         //current task won't be replaced by idle task
         if (task.current_task.type != TaskType::IDLE && action.current_action.type == ActionType::MOVE
@@ -222,8 +482,7 @@ private:
             .target_entity = entity};
     }
 
-    Action move_action(Entity entity, Path path) {
-        auto& next_pos = path.front();
+    Action move_action(Entity entity, const Location& next_pos) {
         return Action{
             .type = ActionType::MOVE, 
             .target_location = Location{next_pos.x, next_pos.y}, 
@@ -233,7 +492,7 @@ private:
     }
     
     Action wander(Entity entity) {
-        int direction = rand() % 4;
+        int direction = router_.get_random().stream(RandomStream::WANDER, entity).uniform(0, 3);
         Location next_pos;
         Location cur_pos = component_manager_.get_component<LocationComponent>(entity).loc;
         
@@ -247,6 +506,11 @@ private:
             next_pos = {cur_pos.x, std::max(cur_pos.y - 1, 0)};
         }
 
+        //do not step into a tile someone has reserved, wait instead
+        auto& reservations = router_.get_reservations();
+        if (!reservations.is_free(next_pos, reservations.now(), reservations.now() + ticks_per_step(entity), entity))
+            next_pos = cur_pos;
+
         return Action{
             .type = ActionType::MOVE, 
             .target_location = next_pos, 
@@ -267,7 +531,10 @@ private:
             return;
         }
 
-        if (!router_.is_valid_position(target_pos)) {
+        //the parallel pass checks the map built before it. collidable movers run in the serial
+        //merge, check the map with the steps taken before them and mark their own new tile
+        bool collidable = component_manager_.get_component<RenderComponent>(entity).collidable;
+        if (collidable ? !router_.is_valid_position(target_pos) : !router_.is_passable(target_pos)) {
             std::cout << "invalid next move target" << std::endl;
             finish_current_action(entity);
             return;
@@ -282,18 +549,8 @@ private:
         if (type == EntityType::CHARACTER && !is_character_available(entity))
             speed *= HAS_TASK_BOOSTER;
     
-        if (router_.to_be_slow(cur_pos))
-            speed *= 0.25;
-
-        if (!component_manager_.has_component<MovementComponent>(entity)) {
-            component_manager_.add_component(entity, MovementComponent{
-                .start_pos = cur_pos,
-                .end_pos = cur_pos, //don't worry, this will be updated when executing move action
-                .progress = 0.0f,
-                .speed = 0, //same to end_pos
-                .path = {}
-            });
-        } 
+        //leaving a slow tile (e.g. door) takes terrain cost times longer
+        speed /= router_.get_terrain_cost(cur_pos);
 
         assert(component_manager_.has_component<MovementComponent>(entity));
 
@@ -306,18 +563,35 @@ private:
 
         if (movement.progress >= 1.0f) {
             cur_pos = target_pos;
-            //reset movement
+            if (collidable)
+                router_.invalidate_collision();
+            //reset movement, but keep following the same path
             movement = MovementComponent{
                 .start_pos = cur_pos,
                 .end_pos = cur_pos,
                 .progress = 0.0f,
                 .speed = BASE_MOVE_SPEED,
-                .move_finished = true
+                .move_finished = true,
+                .path = movement.path,
+                .prev_start_pos = movement.prev_start_pos,
+                .prev_end_pos = movement.prev_end_pos,
+                .prev_progress = movement.prev_progress
             };
             
         }
     }
 
+    void add_movement(Entity entity) {
+        auto& cur_pos = component_manager_.get_component<LocationComponent>(entity).loc;
+        component_manager_.add_component(entity, MovementComponent{
+            .start_pos = cur_pos,
+            .end_pos = cur_pos, //don't worry, this will be updated when executing move action
+            .progress = 0.0f,
+            .speed = 0, //same to end_pos
+            .path = NO_PATH
+        });
+    }
+
     //entity is character
     void chop(Entity entity) {
         std::cout << "entity " << entity << " chop" << std::endl;
@@ -326,16 +600,15 @@ private:
         if (!component_manager_.has_component<TargetComponent>(tree) || 
             !component_manager_.get_component<TargetComponent>(tree).is_target) {
             std::cout << "chop target: " << tree << "is not a target" << std::endl;
+            stop_timed_action(entity);
             return;
         }
         std::cout << "chop target: " << tree << std::endl;
         auto& tree_pos = component_manager_.get_component<LocationComponent>(tree).loc;
         auto& entity_pos = component_manager_.get_component<LocationComponent>(entity).loc;
-        //every update is 1s / framerate(s), duration is 5s
+        //duration is in seconds, the timer fires when it is over
         auto& track = component_manager_.get_component<TargetComponent>(tree);
-        track.progress += 100 / (action.duration * framerate_);
-        std::cout << "chop progress:" << track.progress << std::endl;
-        if (track.progress >= 100) {
+        if (timed_action_done(entity, track, action.duration)) {
             //mark this target so that TaskSystem knows it's finished
             track.is_finished = true;
             //in Tasksystem, if a target of tree is finished, it will be marked 'to delete'
@@ -347,7 +620,7 @@ private:
             Entity temp_entity = entity_manager_.create_entity();
             Location loc = tree_pos;
             component_manager_.add_component(temp_entity, LocationComponent{loc});
-            component_manager_.add_component(temp_entity, CreateComponent{true, 11, EntityType::WOODPACK});
+            component_manager_.add_component(temp_entity, CreateComponent{true, WOODS_PER_TREE, EntityType::WOODPACK});
         }
     }
 
@@ -365,65 +638,38 @@ private:
         //PICK ACTION has target entity of RESOURCE or STORAGE
         //TASK: COLLECT
         if (target_type == EntityType::WOODPACK) {
-            auto pack = target;//one unit has 5 woodpacks
-            if (component_manager_.get_component<RenderComponent>(pack).entityType != EntityType::WOODPACK) {
-                std::cout << "pick target is not woodpack" << std::endl;
-                return;
-            }
-            auto& resource = component_manager_.get_component<ResourceComponent>(pack);
-            auto& amount = resource.amount;
-            auto& holder = resource.holder;
-            //why if? because function is called only on 1 pack of woods
-            if (bag.storage_capacity - bag.current_storage >= 5) {
-                bag.current_storage += amount;
-                bag.stored_resources.emplace_back(target);
-                holder = entity;
-                //once a pack of woods is picked/collected, it is not a target anymore
+            //take as much of the stack as the bag holds
+            auto& resource = component_manager_.get_component<ResourceComponent>(target);
+            int taken = std::min(resource.amount, bag.storage_capacity - bag.current_storage);
+            bag.current_storage += taken;
+            resource.amount -= taken;
+            std::cout << "pick " << taken << " woods from stack " << target << ", " << resource.amount << " left" << std::endl;
+            //an empty stack is not a target anymore, what is left gets a new task
+            if (resource.amount == 0) {
                 auto& track = component_manager_.get_component<TargetComponent>(target);
                 track.is_finished = true;
-                std::cout << "target pack collection " << pack << " is finished" << std::endl;
+                std::cout << "target stack collection " << target << " is finished" << std::endl;
             }
             finish_current_action(entity);
             //TASK: OBTAIN
         } else if (target_type == EntityType::STORAGE) {
-            assert(component_manager_.has_component<StorageComponent>(target));
-            auto& storage = component_manager_.get_component<StorageComponent>(target);
-            
-            int amount = 5;
-            //obtain only 5 woods at one time
-            if (bag.storage_capacity - bag.current_storage >= amount) {
-                if (storage.stored_resources.empty()) {
-                    std::cout << "storage is empty" << std::endl;
-                    finish_current_action(entity);
-                    return;
-                }
-                auto one_pack = storage.stored_resources.front();
-
-                //transfer resource from storage to bag
-                auto& resource = component_manager_.get_component<ResourceComponent>(one_pack);
-                auto& holder = resource.holder;
-
-                //update amount
-                bag.current_storage += amount;
-                storage.current_storage -= amount;
-
-                //transfer ownership
-                bag.stored_resources.emplace_back(one_pack);
-                holder = entity;
-                storage.stored_resources.pop_front();
-
-                std::cout << "pick " << amount << " woods from " << target << " to " << entity << std::endl;
-                std::cout << "now bag carries " << bag.current_storage << " woods" << std::endl;
-                //auto& track = component_manager_.get_component<TargetComponent>(one_pack);
-                //track.is_finished = true;
-            }
+            assert(router_.get_stockpiles().contains(target));
+
+            //take what the delivery reserved here, nothing if it was closed meanwhile
+            auto& ledger = router_.get_delivery_ledger();
+            int job = ledger.job_of(entity);
+            int wanted = 0;
+            if (job != -1 && ledger.find(job)->storage == target)
+                wanted = ledger.find(job)->amount;
+            int taken = router_.get_stockpiles().withdraw(target, std::min(wanted, bag.storage_capacity - bag.current_storage));
+            if (taken < wanted)
+                std::cout << "storage has not enough woods" << std::endl;
+            bag.current_storage += taken;
+            if (job != -1 && ledger.find(job)->storage == target)
+                ledger.picked(job);
+            std::cout << "pick " << taken << " woods from " << target << " to " << entity << std::endl;
+            std::cout << "now bag carries " << bag.current_storage << " woods" << std::endl;
             finish_current_action(entity);
-
-            /* to delete
-            auto& task = component_manager_.get_component<TaskComponent>(entity).current_task;
-            task.finished = true;
-            //THIS IS IMPORTANT, or tasksystem doesn't know this task is finished
-            */
         }
         std::cout << "after pick, bag current storage: " << bag.current_storage << std::endl;
     }
@@ -434,7 +680,6 @@ private:
         auto& action = component_manager_.get_component<ActionComponent>(entity).current_action;
         auto& site = action.target_entity;
         std::cout << "place target: " << site << std::endl;
-        auto& site_pos = component_manager_.get_component<LocationComponent>(site).loc;
         auto& entity_pos = component_manager_.get_component<LocationComponent>(entity).loc;
         auto& carriage = component_manager_.get_component<StorageComponent>(entity);
         auto& storage = component_manager_.get_component<StorageComponent>(site);
@@ -443,21 +688,13 @@ private:
         //TASK: STORE
         if (render.entityType == EntityType::STORAGE) {
             //put all woodpacks into storage
-            storage.current_storage += carriage.current_storage;
+            wood_hauled_ += carriage.current_storage;
+            ++store_trips_;
+            router_.get_stockpiles().deposit(site, carriage.current_storage);
             carriage.current_storage = 0;
 
-            //transfer ownership (entity by entity)
-            while(!carriage.stored_resources.empty()) {
-                auto woodpack = carriage.stored_resources.front();
-                component_manager_.get_component<ResourceComponent>(woodpack).holder = site;
-                storage.stored_resources.emplace_back(woodpack);
-                carriage.stored_resources.pop_front();
-
-                //update location of woodpack
-                auto& wood_loc = component_manager_.get_component<LocationComponent>(woodpack).loc;
-                wood_loc = site_pos;
-            }
-
+            //blueprints parked for lack of wood may be supplied now
+            router_.get_delivery_ledger().supply_added();
             std::cout << "current storage unit has " << storage.current_storage << " woodpacks" << std::endl;
             assert(component_manager_.has_component<TargetComponent>(site));
             auto& track = component_manager_.get_component<TargetComponent>(site);
@@ -472,45 +709,24 @@ private:
 
             //TASK: ALLOCATE
         } else if (render.entityType == EntityType::WALL || render.entityType == EntityType::DOOR) {
-            while(storage.current_storage < storage.storage_capacity && carriage.current_storage > 0) {
-                std::cout << "try allocate woodpack to blueprint" << std::endl;
-                auto& cur_resource = carriage.stored_resources.back();
-                //transfer ownership of current woodpack(entity)
-                component_manager_.get_component<ResourceComponent>(cur_resource).holder = site;
-                
-                //update storage
-                storage.current_storage += 5;
-                carriage.current_storage -= 5;
-                //transfer ownership of current woodpack(entity)
-                component_manager_.get_component<ResourceComponent>(cur_resource).holder = site;
-                storage.stored_resources.emplace_back(cur_resource);
-                carriage.stored_resources.pop_back();
-
-                //check if enough woodpacks to build
+            if (storage.current_storage < storage.storage_capacity && carriage.current_storage > 0) {
+                int amount = std::min(storage.storage_capacity - storage.current_storage, carriage.current_storage);
+                storage.current_storage += amount;
+                carriage.current_storage -= amount;
+                std::cout << "allocate " << amount << " woods to blueprint " << site << std::endl;
+
+                //check if enough woods to build
                 if (storage.current_storage >= storage.storage_capacity) {
-                    std::cout << "enough woodpacks to build" << std::endl;
+                    std::cout << "enough woods to build" << std::endl;
                     component_manager_.get_component<ConstructionComponent>(site).allocated = true;
-                    finish_current_action(entity);
-                    return;
-                    /*to delete
-                    auto& task = component_manager_.get_component<TaskComponent>(entity).current_task;
-                    task.finished = true;
-                    //THIS IS IMPORTANT, or tasksystem doesn't know this task is finished
-                    */
-                //if character carries resource, then he just carries
+                    router_.get_target_events().push(site, TargetEvent::BLUEPRINT_ALLOCATED);
+                } else {
+                    //if character carries resource, then he just carries
                     //until allocate/store task is assigned to him
-                    //check if woodpacks in bag are used up
-                } else if (carriage.current_storage == 0) {
-                    std::cout << "all woodpacks in bag are placed" << std::endl;
-                    finish_current_action(entity);
-
-                    /* to delete
-                    auto& task = component_manager_.get_component<TaskComponent>(entity).current_task;
-                    task.finished = true;
-                    //THIS IS IMPORTANT, or tasksystem doesn't know this task is finished
-                    */
-                    return;
+                    std::cout << "all woods in bag are placed" << std::endl;
                 }
+                finish_current_action(entity);
+                return;
             }
 
             if (carriage.current_storage == 0) {
@@ -531,9 +747,7 @@ private:
         auto blueprint = action.target_entity;
         std::cout << "build target: " << blueprint << std::endl;
         auto& track = component_manager_.get_component<TargetComponent>(blueprint);
-        track.progress += 100 / (action.duration * framerate_);
-        std::cout << "build progress:" << track.progress << std::endl;
-        if (track.progress >= 100) {
+        if (timed_action_done(entity, track, action.duration)) {
             //blueprint not target, won't be added to task queue
             track.is_finished = true;
 
@@ -563,20 +777,10 @@ private:
                 std::cout << "WRONG blueprint doesn't have construction component" << std::endl;
                 component_manager_.add_component(blueprint, ConstructionComponent{.allocated = true, .is_built = true});
             }
+            //a built door slows down whoever walks through it
+            router_.invalidate_collision();
 
-            //remove woods on the site
-            auto& storage = component_manager_.get_component<StorageComponent>(blueprint);
-            while(!storage.stored_resources.empty()) {
-                //delete woodpack from site
-                auto& woodpack = storage.stored_resources.front();
-                storage.stored_resources.pop_front();
-
-                //delete this woodpack entity
-                if (component_manager_.has_component<TargetComponent>(woodpack)) {
-                    component_manager_.get_component<TargetComponent>(woodpack).to_be_deleted = true;
-                }
-            }
-            std::cout << "all woodpacks on site are deleted" << std::endl;
+            //woods on the site are used up by the building, they are only a count
         }
     }
 
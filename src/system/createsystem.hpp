@@ -23,10 +23,12 @@ public:
     }
     void create_entities();
     void destroy_entities();
+    bool is_mover(Entity entity);
+    bool can_sleep(Entity entity);
     void update();
     Entity create_character(Location pos);
     Entity create_tree(Location pos);
-    Entity create_wood(Location pos);
+    Entity create_wood(Location pos, int amount);
     Entity create_wall(Location pos);
     Entity create_door(Location pos);
     Entity create_dog(Location pos);
@@ -53,7 +55,7 @@ void CreateSystem::update() {
 
 void CreateSystem::create_entities() {
     std::cout << "CreateSystem: creating entities" << std::endl;
-    for(auto& entity : router_.get_entities_with_components<CreateComponent>()) {
+    for(auto& entity : router_.get_awake_entities_with_components<CreateComponent>()) {
         if (!component_manager_.has_component<CreateComponent>(entity)) {
             continue;
         }
@@ -70,6 +72,15 @@ void CreateSystem::create_entities() {
                 continue;
             }
             auto& amount = create.amount;
+            //resources are one stack per tile, amount is the size of the stack
+            router_.invalidate_collision();
+            //a stack grown in place or a blocked tile, sleepers around here may have work again
+            router_.wake_around(pos);
+            if (type == EntityType::WOODPACK) {
+                create_wood(pos, amount);
+                entity_manager_.destroy_entity(entity);
+                continue;
+            }
             std::cout << "CreateSystem: creating " << amount << " entities" << std::endl;
             for(int i = 0; i < amount; i++) {
                 switch(type) {
@@ -80,7 +91,7 @@ void CreateSystem::create_entities() {
                         create_tree(pos);
                         break;
                     case EntityType::WOODPACK:
-                        create_wood(pos);
+                        //created as one stack above
                         break;
                     case EntityType::WALL:
                         create_wall(pos);
@@ -101,22 +112,56 @@ void CreateSystem::create_entities() {
     }
 }
 
+//entities put to sleep when they settle: right after they were created or woken, or once
+//the state that kept them up (pending creation, unseen finished target) is over.
+//characters and animals are checked once and then never again, the rest of the awake ones
+//are not looked at
 void CreateSystem::destroy_entities() {
     std::cout << "CreateSystem: destroying entities" << std::endl;
-    for(auto& entity : router_.get_all_entities()) {
-        if (!component_manager_.has_component<TargetComponent>(entity)) {
+    for(auto& entity : entity_manager_.take_unsettled()) {
+        if (!entity_manager_.is_entity_alive(entity) || !entity_manager_.is_awake(entity))
             continue;
-        }
-
-        auto& track = component_manager_.get_component<TargetComponent>(entity);
-        auto& pos = component_manager_.get_component<LocationComponent>(entity).loc;
-        if (track.to_be_deleted) {
+        if (component_manager_.has_component<TargetComponent>(entity)
+            && component_manager_.get_component<TargetComponent>(entity).to_be_deleted) {
             std::cout << "Entity " << entity << " deleted" << std::endl;
+            Location loc = component_manager_.get_component<LocationComponent>(entity).loc;
             entity_manager_.destroy_entity(entity);
-        }   
+            router_.invalidate_collision();
+            router_.wake_around(loc);
+            continue;
+        }
+        if (is_mover(entity))
+            continue;
+        if (can_sleep(entity))
+            router_.sleep(entity);
+        else
+            entity_manager_.keep_unsettled(entity);
     }
 }
 
+bool CreateSystem::is_mover(Entity entity) {
+    if (component_manager_.has_component<TaskComponent>(entity))
+        return true;
+    if (component_manager_.has_component<RenderComponent>(entity)) {
+        auto type = component_manager_.get_component<RenderComponent>(entity).entityType;
+        return type == EntityType::CHARACTER || type == EntityType::DOG;
+    }
+    return false;
+}
+
+//trees, walls, storage tiles and wood stacks wait for someone to act on them, which wakes them.
+//a finished target stays awake until TaskSystem has seen it, so does one about to be deleted
+bool CreateSystem::can_sleep(Entity entity) {
+    if (component_manager_.has_component<CreateComponent>(entity))
+        return false;
+    if (component_manager_.has_component<TargetComponent>(entity)) {
+        auto& target = component_manager_.get_component<TargetComponent>(entity);
+        if (target.to_be_deleted || (target.is_finished && target.is_target))
+            return false;
+    }
+    return true;
+}
+
 Entity CreateSystem::create_character(Location loc) {
     Entity entity = entity_manager_.create_entity();
     std::cout << "Entity " << entity << ": character created at (" << loc.x << ", " << loc.y << ")" << std::endl;
@@ -129,14 +174,17 @@ Entity CreateSystem::create_character(Location loc) {
     };
     StorageComponent storage{
         .storage_capacity = 1100,
-        .current_storage = 0,
-        .stored_resources = {}
+        .current_storage = 0
     };
+    //every work type enabled, player changes it in the work tab
+    WorkPriorityComponent work;
+    work.priority.fill(WORK_PRIORITY_DEFAULT);
 
     component_manager_.add_component(entity, location);
     component_manager_.add_component(entity, move);
     component_manager_.add_component(entity, render);
     component_manager_.add_component(entity, storage);
+    component_manager_.add_component(entity, work);
     characters_.push_back(entity);
     return entity;
 }
@@ -156,12 +204,26 @@ Entity CreateSystem::create_tree(Location loc) {
     return entity;
 }
 
-Entity CreateSystem::create_wood(Location loc) {
+//woods dropped on a tile that already has a loose stack are added to it
+Entity CreateSystem::create_wood(Location loc, int amount) {
+    for (auto& entity : router_.get_entity_at_location(loc)) {
+        if (!component_manager_.has_component<RenderComponent>(entity)
+            || component_manager_.get_component<RenderComponent>(entity).entityType != EntityType::WOODPACK
+            || !component_manager_.has_component<TargetComponent>(entity))
+            continue;
+        auto& track = component_manager_.get_component<TargetComponent>(entity);
+        if (!track.is_target || track.is_finished || track.to_be_deleted)
+            continue;
+        component_manager_.get_component<ResourceComponent>(entity).amount += amount;
+        std::cout << "Entity " << entity << ": " << amount << " woods added to stack" << std::endl;
+        router_.get_target_events().push(entity, TargetEvent::WOOD_DROPPED);
+        return entity;
+    }
+
     Entity entity = entity_manager_.create_entity();
-    std::cout << "Entity " << entity << ": wood created" << std::endl;
+    std::cout << "Entity " << entity << ": stack of " << amount << " woods created" << std::endl;
     LocationComponent location{loc};
-    //one pack has 5 woods without holder
-    ResourceComponent resource{5, -1};
+    ResourceComponent resource{amount, -1};
     RenderComponent render{
         .entityType = EntityType::WOODPACK, 
         .is_selected = false, 
@@ -179,6 +241,7 @@ Entity CreateSystem::create_wood(Location loc) {
     component_manager_.add_component(entity, resource);
     component_manager_.add_component(entity, render);
     component_manager_.add_component(entity, target);
+    router_.get_target_events().push(entity, TargetEvent::WOOD_DROPPED);
 
     return entity;
 }
@@ -210,6 +273,7 @@ Entity CreateSystem::create_wall(Location loc) {
     component_manager_.add_component(entity, storage);
     component_manager_.add_component(entity, render);
     component_manager_.add_component(entity, target);
+    router_.get_target_events().push(entity, TargetEvent::BLUEPRINT_PLACED);
     return entity;
 }
 
@@ -241,6 +305,7 @@ Entity CreateSystem::create_door(Location loc) {
     component_manager_.add_component(entity, storage);
     component_manager_.add_component(entity, render);
     component_manager_.add_component(entity, target);
+    router_.get_target_events().push(entity, TargetEvent::BLUEPRINT_PLACED);
 
     return entity;
 }
@@ -273,6 +338,7 @@ Entity CreateSystem::create_storage(Location loc) {
     component_manager_.add_component(entity, location);
     component_manager_.add_component(entity, storage);
     component_manager_.add_component(entity, render);
+    router_.get_stockpiles().add_tile(entity, loc);
     storages_.emplace_back(entity);
     return entity;
 }
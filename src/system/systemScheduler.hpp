@@ -0,0 +1,166 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include "../components/componentManager.hpp"
+#include "../utils/jobSystem.hpp"
+
+//shared state that is not a component gets a bit of its own, from the top of the mask.
+//the router's parts are separate so systems that use different parts can share a stage
+#define ENTITY_RESOURCE (MAX_COMPONENTS - 1) //creating, destroying and waking entities
+#define GRID_RESOURCE (MAX_COMPONENTS - 2) //collision and cost maps and the landmark tables, any query may rebuild them
+#define RESERVATION_RESOURCE (MAX_COMPONENTS - 3)
+#define PATH_RESOURCE (MAX_COMPONENTS - 4) //path pool
+#define TARGET_EVENT_RESOURCE (MAX_COMPONENTS - 5)
+#define STOCKPILE_RESOURCE (MAX_COMPONENTS - 6) //stockpiles and the delivery ledger, which reserves in them
+#define TIMER_RESOURCE (MAX_COMPONENTS - 7) //timer wheel and the tick of the random streams
+
+//how often a system runs and what one run may cost
+struct SystemTiming {
+    int period = 1; //ticks between runs
+    int offset = 0; //runs on ticks where tick % period == offset, spreads systems of the same period
+    long long budget_us = 0; //0 is no budget, otherwise runs over it are counted in the stats
+};
+
+//runs the world's systems each tick. every system declares what it reads and writes;
+//a system goes into the stage after the last earlier system it conflicts with
+//(one writes what the other reads or writes), so declared order is kept where it matters
+//and systems within a stage run at the same time as jobs.
+//a system with a period > 1 is skipped on the ticks that are not its turn
+class SystemScheduler {
+    struct System {
+        std::string name;
+        ComponentMask reads;
+        ComponentMask writes;
+        std::function<void()> run;
+        SystemTiming timing;
+        int stage = 0;
+        long long total_us = 0;
+        long long max_us = 0;
+        long long runs = 0;
+        long long over_budget = 0;
+        AccessScope scope;
+    };
+
+    std::vector<System> systems_;
+    std::vector<std::vector<int>> stages_; //system indices
+    std::vector<long long> stage_us_;
+    long long runs_ = 0;
+    JobSystem& jobs_;
+
+    static long long since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static bool conflicts(const System& a, const System& b) {
+        return (a.writes & (b.reads | b.writes)).any() || (b.writes & a.reads).any();
+    }
+
+    void run_system(System& system) {
+        auto start = std::chrono::steady_clock::now();
+        system.scope.system = system.name.c_str();
+        system.scope.allowed = system.reads | system.writes;
+        ComponentManager::set_access_scope(&system.scope);
+        system.run();
+        ComponentManager::set_access_scope(nullptr);
+        long long us = since(start);
+        system.total_us += us;
+        system.max_us = std::max(system.max_us, us);
+        ++system.runs;
+        if (system.timing.budget_us > 0 && us > system.timing.budget_us)
+            ++system.over_budget;
+    }
+
+    bool is_due(const System& system) const {
+        return runs_ % system.timing.period == system.timing.offset % system.timing.period;
+    }
+
+public:
+    SystemScheduler(JobSystem& jobs) : jobs_(jobs) {}
+
+    void add(const std::string& name, ComponentMask reads, ComponentMask writes, std::function<void()> run,
+             SystemTiming timing = {}) {
+        System system;
+        system.name = name;
+        system.reads = reads;
+        system.writes = writes;
+        system.run = std::move(run);
+        system.timing = timing;
+        system.timing.period = std::max(timing.period, 1);
+        for (auto& other : systems_)
+            if (conflicts(system, other))
+                system.stage = std::max(system.stage, other.stage + 1);
+        systems_.push_back(std::move(system));
+        auto& added = systems_.back();
+        if (added.stage >= static_cast<int>(stages_.size())) {
+            stages_.resize(added.stage + 1);
+            stage_us_.resize(added.stage + 1, 0);
+        }
+        stages_[added.stage].push_back(static_cast<int>(systems_.size()) - 1);
+    }
+
+    void run() {
+        std::vector<int> due;
+        for (size_t i = 0; i < stages_.size(); ++i) {
+            auto start = std::chrono::steady_clock::now();
+            due.clear();
+            for (auto index : stages_[i])
+                if (is_due(systems_[index]))
+                    due.push_back(index);
+            if (due.size() == 1) {
+                run_system(systems_[due[0]]);
+            } else if (!due.empty()) {
+                JobSystem::Counter counter;
+                for (auto index : due)
+                    jobs_.run([this, index] { run_system(systems_[index]); }, counter);
+                jobs_.wait(counter);
+            }
+            stage_us_[i] += since(start);
+        }
+        ++runs_;
+    }
+
+    int violations() const {
+        int count = 0;
+        for (auto& system : systems_)
+            count += system.scope.violations;
+        return count;
+    }
+
+    //per stage wall time against the time its systems took one after another.
+    //per system the average over all ticks, and for systems with a period or budget the cost of one run
+    void print_stats() const {
+        if (runs_ == 0)
+            return;
+        long long wall = 0, serial = 0;
+        for (size_t i = 0; i < stages_.size(); ++i) {
+            long long stage_serial = 0;
+            std::cout << "stats: stage " << i << " " << stage_us_[i] / runs_ << " us/tick:";
+            for (auto index : stages_[i]) {
+                auto& system = systems_[index];
+                std::cout << " " << system.name << " " << system.total_us / runs_ << " us";
+                if (system.timing.period > 1 || system.timing.budget_us > 0)
+                    std::cout << " (" << system.total_us / std::max(system.runs, 1LL) << " us/run, max " << system.max_us;
+                if (system.timing.period > 1)
+                    std::cout << ", every " << system.timing.period << " ticks";
+                if (system.timing.budget_us > 0)
+                    std::cout << ", budget " << system.timing.budget_us << " us, over " << system.over_budget << " times";
+                if (system.timing.period > 1 || system.timing.budget_us > 0)
+                    std::cout << ")";
+                std::cout << ";";
+                stage_serial += system.total_us;
+            }
+            std::cout << std::endl;
+            wall += stage_us_[i];
+            serial += stage_serial;
+        }
+        std::cout << "stats: " << systems_.size() << " systems in " << stages_.size() << " stages on "
+                  << jobs_.size() << " threads, " << wall / runs_ << " us/tick, speedup "
+                  << static_cast<float>(serial) / std::max(wall, 1LL) << ", "
+                  << violations() << " undeclared accesses" << std::endl;
+    }
+};
@@ -1,19 +1,51 @@
 #pragma once
 #include "utils/path.hpp"
+#include "utils/taskRegistry.hpp"
+#include "utils/assignment.hpp"
+#include "utils/haulPlanner.hpp"
 #include <queue>
+#include <deque>
 #include <algorithm>
+#include <unordered_set>
+
+//matching rounds per tick, a round only repeats when a matched task could not be started
+#define ASSIGN_MAX_ROUNDS 4
+//open tasks each idle character brings into the matching
+#define ASSIGN_CANDIDATES 8
+//cost of one work priority level, larger than any distance / priority score on the map
+#define WORK_LEVEL_COST 1e6
+//loose wood stacks this far (manhattan) from the first one are picked up on the same trip
+#define HAUL_RADIUS 12
+//most collect tasks one haul plan looks at
+#define HAUL_MAX_PICKS 32
+//an idle character is matched to open tasks, and one carrying wood looks for a storage,
+//on one tick in this many. a quarter of them each tick, so the cost is spread evenly
+#define ASSIGN_PERIOD 4
+#define STORAGE_PERIOD 4
+
 class TaskSystem {
     ComponentManager& component_manager_;
     EntityManager& entity_manager_;
     Router& router_;
-    std::vector<Task> task_queue_;
-    std::vector<Task> task_in_progress_;
-    std::unordered_map<Entity, Entity> resource_bind;
+    TaskRegistry tasks_; //queued and in progress tasks
     int map_size_;
     int max_distance_ = map_size_ * map_size_;
     int id_;
+    //collect tasks a character picks up in one trip, and the storage the trip ends at
+    struct HaulPlan {
+        std::deque<int> pickups; //task ids, in route order
+        Entity storage = -1;
+    };
+    std::unordered_map<Entity, HaulPlan> haul_plans_;
+    struct HaulStats {
+        long long plans = 0;
+        long long pickups = 0; //collect tasks handed out by plans, not by the matching
+        long long same_tile = 0; //pickups on the tile the character already stands on
+        long long deliveries = 0; //plans that ended with a store task at their storage
+    } haul_stats_;
     void remove_task_from_progress_by_id(int id);
     void remove_task_from_queue_by_id(int id);
+    void requeue_task(const Task& task);
     void remove_allocate_task_assigned_to_character(Entity entity);
     bool character_carries_resource(Entity entity);
     bool target_entity_in_task_queue(Entity entity);
@@ -21,48 +53,57 @@ class TaskSystem {
     void remove_task_from_queue_by_target(Entity entity);
     void remove_finished_task();
     Entities get_finished_target_entities();
-    Entity find_exist_obtain_target(Entity blueprint);
-    void bind_resource_to_blueprint(Entity reso, Entity blueprint);
-    bool is_resoure_bound_to_blueprint(Entity reso);
-    void update_storage();
+    int blueprint_demand(Entity blueprint);
+    Entity find_supply(const Location& from, int& amount);
+    void close_finished_deliveries();
+    void raise_storage_target(Entity storage);
+    void plan_haul(Entity character, TaskRegistry::Slot seed);
+    bool continue_haul(Entity character, Task& cur_task);
+    void release_haul_plan(Entity character);
+    bool claim_store_task(Entity character, Entity storage, Task& cur_task);
+    bool is_task_candidate(Entity target_entity);
+    Task new_task_for(Entity target_entity);
+    void audit_targets();
 public:
     TaskSystem();
-    TaskSystem(ComponentManager& component_manager, EntityManager& entity_manager, Router& router) : 
+    //router is not constructed yet when World builds its systems, so map size is passed in
+    TaskSystem(ComponentManager& component_manager, EntityManager& entity_manager, Router& router, int map_size) : 
         component_manager_(component_manager),
         entity_manager_(entity_manager),
-        router_(router) {
-        map_size_ = router_.get_map_size();
-        task_queue_.clear();
+        router_(router),
+        tasks_(map_size) {
+        map_size_ = map_size;
+        max_distance_ = map_size_ * map_size_;
         std::cout << "TaskSystem initialized with empty task queue" << std::endl;
         id_ = 0;
     }
 
-    void start_target_timer(Entity entity, float tick_time) {
-        assert(component_manager_.has_component<TargetComponent>(entity));
-        auto& target = component_manager_.get_component<TargetComponent>(entity);
-        target.timer = tick_time;
+    //World runs the phases as separate systems, so each gets its own period and timing:
+    //update_tasks, assign_task, update_storage. the last two take their characters in turns
+    void update_tasks() {
+        std::cout << "TaskSystem updating" << std::endl;
+        update_idle();
+        remove_finished_task();
+        update_task_queue();
     }
 
-    bool is_target_available_at_moment(Entity entity) {
-        assert(component_manager_.has_component<TargetComponent>(entity));
-        auto& target = component_manager_.get_component<TargetComponent>(entity);
-        return target.timer == 0.0;
-    }
+    //characters and animals get a task component as soon as they exist, animals are always idling
+    void update_idle() {
+        for(auto character : router_.get_characters())
+            if (!component_manager_.has_component<TaskComponent>(character))
+                component_manager_.add_component(character, TaskComponent{.current_task = idle_task()});
 
-    void target_timer_tick(Entity entity) {
-        assert(component_manager_.has_component<TargetComponent>(entity));
-        auto& target = component_manager_.get_component<TargetComponent>(entity);
-        target.timer--;
-        if (target.timer < 0.0) target.timer = 0.0;
+        for(auto& animal : router_.get_animals()) {
+            if (!component_manager_.has_component<TaskComponent>(animal))
+                component_manager_.add_component(animal, TaskComponent{idle_task()});
+            if (!router_.is_move_finished(animal)) 
+                continue;
+            component_manager_.get_component<TaskComponent>(animal).current_task = idle_task();
+        }
     }
 
-    void update() {
-        std::cout << "TaskSystem updating" << std::endl;
-        remove_finished_task();
-        update_task_queue();
-        assign_task();
-        update_storage();
-    }
+    //finished deliveries are closed, characters carrying wood look for a storage in turns
+    void update_storage();
 
     //update queue based on existed tasks, which are given by world
     void update_task_queue() {
@@ -70,7 +111,7 @@ public:
 
         //try add back all task that are unfeasible
         //and delete those tasks that target at non-target
-        for(auto& entity : router_.get_entities_with_components<TaskComponent>()) {
+        for(auto& entity : router_.get_awake_entities_with_components<TaskComponent>()) {
             //std::cout << "current entity type: " << router_.printer(entity).first << " ,location: (" << router_.printer(entity).second.x << ", " << router_.printer(entity).second.y << ")" << std::endl;
             auto& cur_task = component_manager_.get_component<TaskComponent>(entity).current_task;
 
@@ -90,21 +131,20 @@ public:
             //add back all tasks that are not feasible
             if (!cur_task.feasible) {
                 std::cout << "a task is not feasible, will be added back to queue" << std::endl;
-                remove_task_from_progress_by_id(cur_task.id);
-                Task old = cur_task;
-                old.feasible = true;
-                old.actor = -1;
+                release_haul_plan(entity);
+                requeue_task(cur_task);
                 cur_task = idle_task();
-                task_queue_.emplace_back(old);
             }
             
             //delete task if target entity is no longer a target
             //here deletion should be considered both in task queue and character's task list
-            if (cur_task.target_action.target_entity != -1) {
+            //obtain draws from a storage, which is only a target while someone stores there
+            if (cur_task.target_action.target_entity != -1 && cur_task.type != TaskType::OBTAIN) {
                 auto& target = cur_task.target_action.target_entity;
                 if (!component_manager_.has_component<TargetComponent>(target) || 
                     !component_manager_.get_component<TargetComponent>(target).is_target) {
                     std::cout << "target entity " << target <<" is no longer a target" << std::endl;
+                    release_haul_plan(entity);
                     remove_task_from_progress_by_id(cur_task.id);
                     remove_task_from_queue_by_id(cur_task.id);
                     cur_task = idle_task();
@@ -113,235 +153,156 @@ public:
             }
         }//space: entity with task component(character or animal)
         
-        //add new tasks into queue
-        for (auto& target_entity : router_.get_entities_with_components<TargetComponent>()) {
-            if (target_entity_in_task_queue(target_entity)) {
-                std::cout << "target is already in queue" << std::endl;
+        //add new tasks into queue, only for targets changed since last tick
+        auto& events = router_.get_target_events();
+#ifndef NDEBUG
+        auto& timers = router_.get_timers();
+        if (!timers.fired(TimerTag::TARGET_AUDIT).empty())
+            audit_targets();
+        if (!timers.is_scheduled(WORLD_TIMER, TimerTag::TARGET_AUDIT))
+            timers.schedule(WORLD_TIMER, TimerTag::TARGET_AUDIT, TARGET_AUDIT_TICK);
+#endif
+        for (auto& target_entity : events.drain()) {
+            //designated, raised or released, it has something to do again
+            entity_manager_.wake(target_entity);
+            if (!is_task_candidate(target_entity))
                 continue;
-            }
-
-            if (is_target_in_progress(target_entity)) {
-                std::cout << "target is already in progress" << std::endl;
-                continue;
-            }
-
-            if (component_manager_.get_component<TargetComponent>(target_entity).to_be_deleted) {
-                std::cout << "target entity: " << target_entity << " is to be deleted" << std::endl;
-                continue;
-            }
-
-            auto& track = component_manager_.get_component<TargetComponent>(target_entity);
-            if (!track.is_target || track.is_finished) {
-                std::cout << "target entity: " << target_entity << " is not a target" << std::endl;
-                continue;
-            }
-
-            auto tmp_type = router_.printer(target_entity).first;
-            auto tmp_loc = router_.printer(target_entity).second;
-            Task new_task = empty_task();
-
-            if (!component_manager_.has_component<RenderComponent>(target_entity)) {
-                std::cout << "wrong! current entity has no render component" << std::endl;
-                continue;
-            }
 
+            Task new_task = new_task_for(target_entity);
+            auto& tmp_loc = component_manager_.get_component<LocationComponent>(target_entity).loc;
             auto target_type = component_manager_.get_component<RenderComponent>(target_entity).entityType;
             std::cout << "new task, target: " << target_entity;
             std::cout << " Target type: " << target_type << ", Location: (" << tmp_loc.x << ", " << tmp_loc.y << ")" << std::endl;
-            
-            bool valid_task = false;
-            //chop tree
-            if (target_type == EntityType::TREE) {
-                std::cout << "find new task: chop tree" << std::endl;
-                new_task = chop_task(target_entity);
-                valid_task = true;
-            }
-            //collect resource from tree
-            else if (target_type == EntityType::WOODPACK) {
-                auto& resource = component_manager_.get_component<ResourceComponent>(target_entity);
-                if (resource.holder == -1) {
-                    std::cout << "find new task: collect resource" << std::endl;
-                    new_task = collect_task(target_entity);
-                    valid_task = true;
-                }
-            }
-            else if (target_type == EntityType::WALL || target_type == EntityType::DOOR) {
-
-                if(!component_manager_.get_component<ConstructionComponent>(target_entity).allocated
-                    && !component_manager_.get_component<ConstructionComponent>(target_entity).is_built) {
-                    //allocate resource to blueprint
-                    std::cout << "find new task: allocate resource" << std::endl;
-                    new_task = allocate_task(target_entity);
-                    valid_task = true;
-                } else if (component_manager_.get_component<ConstructionComponent>(target_entity).allocated
-                    && !component_manager_.get_component<ConstructionComponent>(target_entity).is_built) {
-                    //construct blueprint
-                    std::cout << "find new task: construct blueprint" << std::endl;
-                    new_task = construct_task(target_entity);
-                    valid_task = true;
-                }
-            }
-            //store resource to storage area
-            else if (target_type == EntityType::STORAGE) {
-                assert( component_manager_.has_component<StorageComponent>(target_entity) );
-                std::cout << "find new task: store resource" << std::endl;
-                new_task = store_task(target_entity);
-                valid_task = true;
-            }
-            //obtain task is only called when there is a allocate task
-            
-            if (valid_task) {
-                task_queue_.emplace_back(new_task);
-            } else {
-                std::cout << "invalid task!" << std::endl;
-            }
-        }//space: entity with target component
+            tasks_.add(new_task, TaskRegistry::State::QUEUED);
+        }//space: changed target entities
 
-        std::cout << "after update queue, task wait for assign: " << task_queue_.size() << std::endl;
+        std::cout << "after update queue, task wait for assign: " << tasks_.queued().size() << std::endl;
 
-        if (!task_queue_.empty()) {
-            auto& head = task_queue_.front();
+        if (!tasks_.queued().empty()) {
+            auto& head = tasks_.get(tasks_.queued().front());
             head.print_task_info();
         }
 
-        std::cout << "task in progress: " << task_in_progress_.size() << std::endl;
-        if (!task_in_progress_.empty()) {
-            auto& head = task_in_progress_.front();
+        std::cout << "task in progress: " << tasks_.in_progress().size() << std::endl;
+        if (!tasks_.in_progress().empty()) {
+            auto& head = tasks_.get(tasks_.in_progress().front());
             head.print_task_info();
         }
     }
 
+    //all idle characters and their nearby open tasks are matched together, so that the total of
+    //distance / priority scores is minimal instead of first come first served.
+    //each idle character takes part on its turn, one tick in ASSIGN_PERIOD. a character in the
+    //middle of a wander step is matched too: it finishes the step and then heads for the task
     void assign_task() {
         std::cout << "assigning tasks" << std::endl;
+        Entities idle;
         for(auto character : router_.get_characters()) {
-            std::cout << "assign task to character " << character << std::endl;
-            bool is_assigned_task = false;
-            if (!component_manager_.has_component<TaskComponent>(character)) 
-                component_manager_.add_component(character, TaskComponent{.current_task = idle_task()});
-
             auto& character_task = component_manager_.get_component<TaskComponent>(character);
-            if(character_task.current_task.type != TaskType::IDLE || !router_.is_move_finished(character))
+            if(character_task.current_task.type != TaskType::IDLE
+                || !router_.get_timers().on_turn(character, ASSIGN_PERIOD))
                 continue;
+            release_haul_plan(character);
+            idle.push_back(character);
+        }
 
-            std::cout << "task queue has tasks: " << task_queue_.size() << std::endl;
-            if (task_queue_.empty())
-                continue;
-
-            //sort task queue according to how far each task is from character
-            //also consider task priority
-            auto char_loc = component_manager_.get_component<LocationComponent>(character).loc;
-            std::sort(task_queue_.begin(), task_queue_.end(), [&char_loc](const Task& a, const Task& b) {
-                auto distance_squared = [](const Task& task, const Location& loc) -> double {
-                    Location tar = task.target_locations[0];
-                    double dx = tar.x - loc.x;
-                    double dy = tar.y - loc.y;
-                    return dx * dx + dy * dy; 
-                };
-
-                double score_a = (a.priority > 0 ? 1.0 / a.priority : std::numeric_limits<double>::max()) *
-                     distance_squared(a, char_loc);
-                double score_b = (b.priority > 0 ? 1.0 / b.priority : std::numeric_limits<double>::max()) *
-                     distance_squared(b, char_loc);
-                return score_a < score_b;
-            });
-
-            for(auto task = task_queue_.begin(); task != task_queue_.end();) {
-                if (task -> actor != -1 && task -> actor != character) {
-                    std::cout << "this task is owned by entity " << task -> actor << ", while current entity is " << character << std::endl; 
-                    ++task;
-                    continue;
-                }
-
-                //attention! target_pos is a set of locations
-                auto targets = task->target_locations; 
-                auto character_pos = component_manager_.get_component<LocationComponent>(character).loc;
-                auto& character_tasks = component_manager_.get_component<TaskComponent>(character);
-                //std::cout << "character is at (" << character_pos.x << ", " << character_pos.y << ")" << std::endl;
-                //std::cout << "task is at (" << targets[0].x << ", " << targets[0].y << ")" << std::endl;
-                
-                if (true || router_.is_reachable(character_pos, targets)) {
-                    //std::cout << "reachable!" << std::endl;
-                    if ( (task->type == TaskType::ALLOCATE || task->type == TaskType::STORE)
-                    && character_carries_resource(character)) {
-                        task->actor = character;
-                        character_tasks.current_task = *task;
-                        task_in_progress_.emplace_back(*task);
-                        task = task_queue_.erase(task);
-                        is_assigned_task = true;
-                        std::cout << "character has resource in hand, allocate or store resource" << std::endl;
-                        break;
-                    } else if (Entity dst_storage; 
-                    task->type == TaskType::ALLOCATE 
-                    && !character_carries_resource(character)) {
-                        auto blueprint = task->target_action.target_entity;
-
-                        if (!is_target_available_at_moment(blueprint)) {
-                            target_timer_tick(blueprint);
-                            ++task;
+        std::cout << "task queue has tasks: " << tasks_.queued().size() << ", idle characters: " << idle.size() << std::endl;
+        //blueprints parked for lack of supply are looked at again only after wood was stored
+        auto woken = router_.get_delivery_ledger().wake();
+        if (!woken.empty())
+            std::cout << woken.size() << " blueprints woken by new supply" << std::endl;
+        if (!idle.empty() && !tasks_.queued().empty()) {
+            std::vector<Worker> workers;
+            for (auto character : idle)
+                workers.push_back(make_worker(character));
+            std::vector<bool> assigned(idle.size(), false);
+            std::unordered_set<TaskRegistry::Slot> closed;
+            for (int round = 0; round < ASSIGN_MAX_ROUNDS; ++round) {
+                //columns: the best few tasks around each idle character, found in the spatial queue
+                std::vector<size_t> rows;
+                std::vector<TaskRegistry::Slot> cols;
+                std::unordered_set<TaskRegistry::Slot> seen;
+                for (size_t i = 0; i < idle.size(); ++i) {
+                    if (assigned[i])
+                        continue;
+                    rows.push_back(i);
+                    auto& worker = workers[i];
+                    auto accept = [&](TaskRegistry::Slot slot) {
+                        if (closed.count(slot))
+                            return false;
+                        auto& task = tasks_.get(slot);
+                        return assign_cost(worker, task, is_blueprint_parked(task)) < ASSIGN_FORBIDDEN;
+                    };
+                    //only enabled work types, the first work priority that has anything to do wins
+                    for (int level = WORK_PRIORITY_HIGHEST; level <= WORK_PRIORITY_LOWEST; ++level) {
+                        std::vector<int> types;
+                        for (int type = 0; type < TASK_TYPE_COUNT; ++type)
+                            if (worker.work.priority[type] == level) types.push_back(type);
+                        if (types.empty())
                             continue;
-                        } 
-
-                        dst_storage = find_exist_obtain_target(blueprint);
-                        if (dst_storage == -1) {
-                            auto temp_storage = component_manager_.get_component<StorageComponent>(blueprint);
-                            int needed_amount = temp_storage.storage_capacity - temp_storage.current_storage;
-                            if (find_resource_destination(character, dst_storage, needed_amount))
-                                bind_resource_to_blueprint(dst_storage, blueprint);
-                        } 
-                        if (dst_storage != -1) {
-                            Task obtain = obtain_task(dst_storage, character);
-
-                            //here mark the ownership of ALLOCATE task and OBTAIN task
-                            obtain.actor = character;
-                            task->actor = character;
-
-                            character_tasks.current_task = obtain;
-                            task_in_progress_.emplace_back(obtain);
-                            is_assigned_task = true;
-                            std::cout << "character has no resource, but find a storage area to obtain resources" << std::endl;
+                        auto nearby = tasks_.nearest_queued(worker.loc, ASSIGN_CANDIDATES, accept, types);
+                        for (auto slot : nearby)
+                            if (seen.insert(slot).second) cols.push_back(slot);
+                        if (!nearby.empty())
                             break;
-                        } else {
-                            start_target_timer(blueprint, 100); //wait 100 rounds
-                        }
                     }
-                    else if (task->type != TaskType::ALLOCATE && task->type != TaskType::STORE) {
-                        // chop/construct/collect
-                        task->actor = character;
-                        character_tasks.current_task = *task;
-                        task_in_progress_.emplace_back(*task);
-                        task = task_queue_.erase(task);
-                        is_assigned_task = true;
-                        std::cout << "found task, start to do it" << std::endl;
-                        break;
-                    } else {//this if includes that task is allocate but no resource to allocate
-                        std::cout << "current task not assigned, go next" << std::endl;
-                        ++task;
+                }
+                if (rows.empty() || cols.empty())
+                    break;
+
+                std::vector<bool> parked(cols.size());
+                for (size_t c = 0; c < cols.size(); ++c)
+                    parked[c] = is_blueprint_parked(tasks_.get(cols[c]));
+                std::vector<std::vector<double>> cost(rows.size(), std::vector<double>(cols.size()));
+                for (size_t r = 0; r < rows.size(); ++r)
+                    for (size_t c = 0; c < cols.size(); ++c)
+                        cost[r][c] = assign_cost(workers[rows[r]], tasks_.get(cols[c]), parked[c]);
+
+                //a matched pair may still fail (no resource to obtain), that task is closed
+                //for this tick and the rest are matched again
+                bool retry = false;
+                auto match = Assignment::solve(cost);
+                for (size_t r = 0; r < rows.size(); ++r) {
+                    if (match[r] == -1)
                         continue;
-                    }
-                } else {
-                    std::cout << "unreachable task for character " << character << std::endl;
-                    ++task;
-                    continue;
+                    size_t i = rows[r];
+                    auto slot = cols[match[r]];
+                    closed.insert(slot);
+                    if (try_assign(idle[i], slot))
+                        assigned[i] = true;
+                    else
+                        retry = true;
                 }
+                if (!retry)
+                    break;
             }
 
-            //if no task is assigned, let character idle
-            if (!is_assigned_task) {
-                character_task.current_task = idle_task();
-            }
-
-            router_.print_character_current_task(character);
+            for (size_t i = 0; i < idle.size(); ++i)
+                if (assigned[i]) router_.print_character_current_task(idle[i]);
         }
-        std::cout << "After assign: task wait for assign: " << task_queue_.size() << ", task in progress: " << task_in_progress_.size() << std::endl;
-        
-        //animals are always idling
-        for(auto& animal : router_.get_animals()) {
-            if (!component_manager_.has_component<TaskComponent>(animal))
-                component_manager_.add_component(animal, TaskComponent{idle_task()});
-            if (!router_.is_move_finished(animal)) 
-                continue;
-            component_manager_.get_component<TaskComponent>(animal).current_task = idle_task();
+
+        //if no task is assigned, let character idle
+        for (auto character : idle) {
+            auto& character_task = component_manager_.get_component<TaskComponent>(character);
+            if (character_task.current_task.type == TaskType::IDLE)
+                character_task.current_task = idle_task();
         }
+        std::cout << "After assign: task wait for assign: " << tasks_.queued().size() << ", task in progress: " << tasks_.in_progress().size() << std::endl;
+    }
+
+    void print_haul_stats() {
+        std::cout << "stats: " << haul_stats_.plans << " haul plans, " << haul_stats_.pickups << " pickups without matching, "
+                  << haul_stats_.same_tile << " without moving, " << haul_stats_.deliveries << " planned deliveries" << std::endl;
+        router_.get_stockpiles().print_stats();
+        auto& ledger = router_.get_delivery_ledger();
+        std::cout << "stats: " << ledger.size() << " construction deliveries open, " << ledger.parked() << " blueprints parked" << std::endl;
+    }
+
+    //every work type enabled at default priority
+    static WorkPriorityComponent default_work_priorities() {
+        WorkPriorityComponent work;
+        work.priority.fill(WORK_PRIORITY_DEFAULT);
+        return work;
     }
 
     Task empty_task();
@@ -370,78 +331,211 @@ public:
     
 
 private:
-    bool find_resource_destination(Entity target, Entity& dst, int resource_amount) {
-        //std::cout << "try find resource destination" << std::endl;
-        bool path_exists = false;
-        int distance = max_distance_;
-        Location final_dst;
-        for (auto& entity : router_.get_storage_areas()) {
-            //find storage or blueprint
-            auto src_pos = component_manager_.get_component<LocationComponent>(target).loc;
-            auto dst_pos = component_manager_.get_component<LocationComponent>(entity).loc;
-            auto& storage = component_manager_.get_component<StorageComponent>(entity);
-            if ( src_pos == dst_pos || 
-                (router_.find_path_Ax(src_pos, dst_pos).size() != 0 
-                && storage.current_storage < storage.storage_capacity
-                && ( storage.current_storage >= resource_amount ) ) ) {
-                if (!path_exists) {
-                    path_exists = true;
-                    distance = router_.calculate_distance(src_pos, dst_pos);
-                    dst = entity;
-                } else if (router_.calculate_distance(src_pos, dst_pos) < distance) {
-                    distance = router_.calculate_distance(src_pos, dst_pos);
-                    dst = entity;
-                    final_dst = dst_pos;
-                }
+    //characters without a work tab do everything at default priority
+    WorkPriorityComponent& work_priorities(Entity character) {
+        if (!component_manager_.has_component<WorkPriorityComponent>(character))
+            component_manager_.add_component(character, default_work_priorities());
+        return component_manager_.get_component<WorkPriorityComponent>(character);
+    }
+
+    //what the assignment needs to know about an idle character, read once per tick
+    struct Worker {
+        Entity entity;
+        Location loc;
+        bool carries;
+        WorkPriorityComponent work;
+    };
+
+    Worker make_worker(Entity character) {
+        return Worker{
+            .entity = character,
+            .loc = component_manager_.get_component<LocationComponent>(character).loc,
+            .carries = character_carries_resource(character),
+            .work = work_priorities(character)
+        };
+    }
+
+    //allocate task of a blueprint that no storage can supply right now, only carriers can take it
+    bool is_blueprint_parked(const Task& task) {
+        return task.type == TaskType::ALLOCATE && router_.get_delivery_ledger().is_parked(task.target_action.target_entity);
+    }
+
+    //squared distance over priority, ASSIGN_FORBIDDEN if the character can not take the task now.
+    //each work priority level below the first adds WORK_LEVEL_COST, more than any distance score,
+    //so the matching fills higher work priorities first
+    double assign_cost(const Worker& worker, const Task& task, bool blueprint_parked) {
+        if (task.actor != -1 && task.actor != worker.entity)
+            return ASSIGN_FORBIDDEN;
+        int level = worker.work.priority[task.type];
+        if (level == WORK_DISABLED)
+            return ASSIGN_FORBIDDEN;
+        if (task.type == TaskType::STORE && !worker.carries)
+            return ASSIGN_FORBIDDEN;
+        if (blueprint_parked && !worker.carries)
+            return ASSIGN_FORBIDDEN;
+        if (task.priority <= 0)
+            return ASSIGN_FORBIDDEN;
+
+        auto& loc = worker.loc;
+        auto& tar = task.target_locations[0];
+        double dx = tar.x - loc.x;
+        double dy = tar.y - loc.y;
+        return (level - WORK_PRIORITY_HIGHEST) * WORK_LEVEL_COST + (dx * dx + dy * dy) / task.priority;
+    }
+
+    //give the matched task to the character, false if it turns out it can not be done now
+    bool try_assign(Entity character, TaskRegistry::Slot slot) {
+        auto task = &tasks_.get(slot);
+        auto& character_tasks = component_manager_.get_component<TaskComponent>(character);
+        auto& ledger = router_.get_delivery_ledger();
+        auto& bag = component_manager_.get_component<StorageComponent>(character);
+        //the character's own delivery to this blueprint is planned again from what it has now
+        auto own = ledger.find(ledger.job_of(character));
+        if (own && task->type == TaskType::ALLOCATE && own->blueprint == task->target_action.target_entity)
+            ledger.close(own->id);
+        if (task->type == TaskType::ALLOCATE && blueprint_demand(task->target_action.target_entity) <= 0) {
+            std::cout << "blueprint " << task->target_action.target_entity << " is already supplied" << std::endl;
+            return false;
+        }
+        if ( (task->type == TaskType::ALLOCATE || task->type == TaskType::STORE)
+        && character_carries_resource(character)) {
+            //wood in the bag goes straight to the blueprint
+            if (task->type == TaskType::ALLOCATE) {
+                auto blueprint = task->target_action.target_entity;
+                ledger.reserve(blueprint, -1, character, std::min(bag.current_storage, blueprint_demand(blueprint)));
             }
+            tasks_.set_actor(slot, character);
+            tasks_.set_state(slot, TaskRegistry::State::IN_PROGRESS);
+            character_tasks.current_task = *task;
+            std::cout << "character has resource in hand, allocate or store resource" << std::endl;
+            return true;
+        } else if (task->type == TaskType::ALLOCATE) {
+            auto blueprint = task->target_action.target_entity;
+            //one delivery for all the blueprint still needs, as far as the bag allows
+            int amount = std::min(blueprint_demand(blueprint), bag.storage_capacity - bag.current_storage);
+            Entity dst_storage = find_supply(component_manager_.get_component<LocationComponent>(character).loc, amount);
+            if (dst_storage == -1) {
+                ledger.park(blueprint);
+                std::cout << "no supply for blueprint " << blueprint << ", parked until wood is stored" << std::endl;
+                return false;
+            }
+            ledger.reserve(blueprint, dst_storage, character, amount);
+            Task obtain = obtain_task(dst_storage, character);
+
+            //here mark the ownership of ALLOCATE task and OBTAIN task
+            obtain.actor = character;
+            tasks_.set_actor(slot, character);
+
+            character_tasks.current_task = obtain;
+            tasks_.add(obtain, TaskRegistry::State::IN_PROGRESS);
+            std::cout << "character has no resource, but find a storage area to obtain resources" << std::endl;
+            return true;
         }
-        if (path_exists) 
-            std::cout << "find storage " << dst << " at (" << final_dst.x << ", " << final_dst.y << ")" << std::endl;
-        else 
+        // chop/construct/collect
+        tasks_.set_actor(slot, character);
+        tasks_.set_state(slot, TaskRegistry::State::IN_PROGRESS);
+        character_tasks.current_task = *task;
+        std::cout << "found task, start to do it" << std::endl;
+        if (task->type == TaskType::COLLECT)
+            plan_haul(character, slot);
+        return true;
+    }
+
+    //a storage tile with room in the nearest stockpile zone, no search over every tile
+    bool find_resource_destination(Entity target, Entity& dst) {
+        auto& src_pos = component_manager_.get_component<LocationComponent>(target).loc;
+        dst = router_.get_stockpiles().find_drop(src_pos);
+        if (dst != -1) {
+            auto& dst_pos = component_manager_.get_component<LocationComponent>(dst).loc;
+            std::cout << "find storage " << dst << " at (" << dst_pos.x << ", " << dst_pos.y << ")" << std::endl;
+        } else {
             std::cout << "no resource destination found" << std::endl;
-        return path_exists;
+        }
+        return dst != -1;
     }
 };
 
 bool TaskSystem::target_entity_in_task_queue(Entity entity) {
-    for (auto& task : task_queue_) {
-        if (task.target_action.target_entity == entity)
-            return true;
-    }
-    return false;
+    return tasks_.has_target(entity, TaskRegistry::State::QUEUED);
 }
 
 bool TaskSystem::is_target_in_progress(Entity entity) {
-    for (auto& task : task_in_progress_) {
-        auto& target = task.target_action.target_entity;
-        if (target == entity)
-                return true;
-    }
-    return false;
+    return tasks_.has_target(entity, TaskRegistry::State::IN_PROGRESS);
 } 
 
+//a removed task leaves its target without one, look at the target again next tick
 void TaskSystem::remove_task_from_progress_by_id(int id) {
-    for(auto task = task_in_progress_.begin(); task != task_in_progress_.end();) {
-        if (task->id == id) task = task_in_progress_.erase(task);
-        else ++task;
+    auto slot = tasks_.find(id);
+    if (slot != TaskRegistry::NO_SLOT && tasks_.state(slot) == TaskRegistry::State::IN_PROGRESS) {
+        router_.get_target_events().push(tasks_.get(slot).target_action.target_entity, TargetEvent::TASK_RELEASED);
+        tasks_.remove(slot);
     }
 }
 
 void TaskSystem::remove_task_from_queue_by_id(int id) {
-    for(auto task = task_queue_.begin(); task != task_queue_.end();) {
-        if (task->id == id) task = task_queue_.erase(task);
-        else ++task;
+    auto slot = tasks_.find(id);
+    if (slot != TaskRegistry::NO_SLOT && tasks_.state(slot) == TaskRegistry::State::QUEUED) {
+        router_.get_target_events().push(tasks_.get(slot).target_action.target_entity, TargetEvent::TASK_RELEASED);
+        tasks_.remove(slot);
+    }
+}
+
+//put a task given up by its actor back into queue, the registered task is reused if still there
+void TaskSystem::requeue_task(const Task& task) {
+    auto slot = tasks_.find(task.id);
+    if (slot != TaskRegistry::NO_SLOT) {
+        tasks_.set_actor(slot, -1);
+        tasks_.set_state(slot, TaskRegistry::State::QUEUED);
+        return;
     }
+    Task old = task;
+    old.feasible = true;
+    old.actor = -1;
+    tasks_.add(old, TaskRegistry::State::QUEUED);
 }
 
 void TaskSystem::remove_allocate_task_assigned_to_character(Entity entity) {
-    for(auto task = task_queue_.begin(); task != task_queue_.end();) {
-        if (task -> type == TaskType::ALLOCATE && task -> actor == entity) task = task_queue_.erase(task);
-        else ++task;
+    //copy, removing changes the index
+    auto slots = tasks_.by_actor(entity);
+    for (auto slot : slots) {
+        if (tasks_.get(slot).type == TaskType::ALLOCATE && tasks_.state(slot) == TaskRegistry::State::QUEUED) {
+            router_.get_target_events().push(tasks_.get(slot).target_action.target_entity, TargetEvent::TASK_RELEASED);
+            tasks_.remove(slot);
+        }
     }
-    for(auto task = task_queue_.begin(); task != task_queue_.end();) {
-        if (task -> type == TaskType::ALLOCATE && task -> actor == entity) task = task_queue_.erase(task);
-        else ++task;
+}
+
+//wood the blueprint still needs that no delivery is bringing yet
+int TaskSystem::blueprint_demand(Entity blueprint) {
+    auto& storage = component_manager_.get_component<StorageComponent>(blueprint);
+    return storage.storage_capacity - storage.current_storage - router_.get_delivery_ledger().inbound(blueprint);
+}
+
+//storage tile with unreserved wood in the nearest stockpile zone, amount is cut down to what it can give.
+//-1 if no storage has any to spare
+Entity TaskSystem::find_supply(const Location& from, int& amount) {
+    if (amount <= 0)
+        return -1;
+    return router_.get_stockpiles().find_stock(from, amount);
+}
+
+//a delivery is over once its blueprint is allocated, or its allocate task is gone or given up
+void TaskSystem::close_finished_deliveries() {
+    auto& ledger = router_.get_delivery_ledger();
+    for (auto id : ledger.job_ids()) {
+        auto job = *ledger.find(id);
+        bool open = false;
+        if (entity_manager_.is_entity_alive(job.blueprint)
+            && component_manager_.has_component<ConstructionComponent>(job.blueprint)
+            && !component_manager_.get_component<ConstructionComponent>(job.blueprint).allocated) {
+            for (auto slot : tasks_.by_target(job.blueprint))
+                if (tasks_.get(slot).type == TaskType::ALLOCATE && tasks_.get(slot).actor == job.actor)
+                    open = true;
+        }
+        if (!open) {
+            std::cout << "delivery " << id << " to blueprint " << job.blueprint << " is closed" << std::endl;
+            ledger.close(id);
+        }
     }
 }
 
@@ -452,15 +546,9 @@ bool TaskSystem::character_carries_resource(Entity entity) {
 }
 
 void TaskSystem::remove_task_from_queue_by_target(Entity entity) {
-    for(auto it = task_in_progress_.begin(); it != task_in_progress_.end();) {
-        if (it->target_action.target_entity == entity) it = task_in_progress_.erase(it);
-        else ++it;
-    }
-
-    for(auto it = task_queue_.begin(); it != task_queue_.end();) {
-        if (it->target_action.target_entity == entity) it = task_queue_.erase(it);
-        else ++it;
-    }
+    auto slots = tasks_.by_target(entity);
+    for (auto slot : slots)
+        tasks_.remove(slot);
 }
 
 void TaskSystem::remove_finished_task() {
@@ -482,7 +570,8 @@ void TaskSystem::remove_finished_task() {
             if (curTask.type == TaskType::IDLE) 
                 continue;
             remove_task_from_progress_by_id(curTask.id);
-            curTask = idle_task();
+            if (curTask.type != TaskType::COLLECT || !continue_haul(character, curTask))
+                curTask = idle_task();
         }
 
         if (curTask.type == TaskType::ALLOCATE && curTask.feasible) {
@@ -498,35 +587,122 @@ void TaskSystem::remove_finished_task() {
 
         //extra logic avoid repeated collect
         if (curTask.type == TaskType::COLLECT && curTask.feasible) {
-            auto& woodpack = curTask.target_action.target_entity;
-            if (component_manager_.has_component<ResourceComponent>(woodpack)) {
-                auto& resource = component_manager_.get_component<ResourceComponent>(woodpack);
-                if (resource.holder != -1) {
+            auto& stack = curTask.target_action.target_entity;
+            if (component_manager_.has_component<ResourceComponent>(stack)) {
+                auto& resource = component_manager_.get_component<ResourceComponent>(stack);
+                if (resource.amount == 0) {
                     remove_task_from_progress_by_id(curTask.id);
-                    curTask = idle_task();
+                    if (!continue_haul(character, curTask))
+                        curTask = idle_task();
                 }
             }
         }
     }
 }
 
+//same checks the task queue used to run on every target every tick
+bool TaskSystem::is_task_candidate(Entity target_entity) {
+    //dirty targets may have been destroyed since
+    if (!entity_manager_.is_entity_alive(target_entity) || !component_manager_.has_component<TargetComponent>(target_entity))
+        return false;
+
+    if (target_entity_in_task_queue(target_entity)) {
+        std::cout << "target is already in queue" << std::endl;
+        return false;
+    }
+
+    if (is_target_in_progress(target_entity)) {
+        std::cout << "target is already in progress" << std::endl;
+        return false;
+    }
+
+    auto& track = component_manager_.get_component<TargetComponent>(target_entity);
+    if (track.to_be_deleted) {
+        std::cout << "target entity: " << target_entity << " is to be deleted" << std::endl;
+        return false;
+    }
+
+    if (!track.is_target || track.is_finished) {
+        std::cout << "target entity: " << target_entity << " is not a target" << std::endl;
+        return false;
+    }
+
+    if (!component_manager_.has_component<RenderComponent>(target_entity)) {
+        std::cout << "wrong! current entity has no render component" << std::endl;
+        return false;
+    }
+
+    auto target_type = component_manager_.get_component<RenderComponent>(target_entity).entityType;
+    if (target_type == EntityType::TREE || target_type == EntityType::STORAGE)
+        return true;
+    //collect resource from tree
+    if (target_type == EntityType::WOODPACK)
+        return component_manager_.get_component<ResourceComponent>(target_entity).amount > 0;
+    //allocate resource to blueprint, or construct it
+    if (target_type == EntityType::WALL || target_type == EntityType::DOOR)
+        return !component_manager_.get_component<ConstructionComponent>(target_entity).is_built;
+
+    std::cout << "invalid task!" << std::endl;
+    return false;
+}
+
+//target must pass is_task_candidate
+//obtain task is only created when there is a allocate task
+Task TaskSystem::new_task_for(Entity target_entity) {
+    auto target_type = component_manager_.get_component<RenderComponent>(target_entity).entityType;
+    if (target_type == EntityType::TREE) {
+        std::cout << "find new task: chop tree" << std::endl;
+        return chop_task(target_entity);
+    }
+    if (target_type == EntityType::WOODPACK) {
+        std::cout << "find new task: collect resource" << std::endl;
+        return collect_task(target_entity);
+    }
+    if (target_type == EntityType::STORAGE) {
+        assert( component_manager_.has_component<StorageComponent>(target_entity) );
+        std::cout << "find new task: store resource" << std::endl;
+        return store_task(target_entity);
+    }
+    if (!component_manager_.get_component<ConstructionComponent>(target_entity).allocated) {
+        std::cout << "find new task: allocate resource" << std::endl;
+        return allocate_task(target_entity);
+    }
+    std::cout << "find new task: construct blueprint" << std::endl;
+    return construct_task(target_entity);
+}
+
+//walk every target like the old per tick scan did, report and requeue targets that
+//should have a task but were never marked dirty
+void TaskSystem::audit_targets() {
+    auto& events = router_.get_target_events();
+    int missed = 0;
+    for (auto& target_entity : router_.get_entities_with_components<TargetComponent>()) {
+        if (events.is_dirty(target_entity) || !is_task_candidate(target_entity))
+            continue;
+        std::cout << "audit: target " << target_entity << " has no task and no event" << std::endl;
+        events.push(target_entity, TargetEvent::TASK_RELEASED);
+        ++missed;
+    }
+    std::cout << "audit: " << missed << " targets missed" << std::endl;
+}
+
+//targets are woken when they are finished, sleeping ones are skipped
 Entities TaskSystem::get_finished_target_entities() {
     Entities entities;
-    for(auto& entity : router_.get_all_entities()) {
+    for(auto& entity : router_.get_awake_entities()) {
         if (component_manager_.has_component<TargetComponent>(entity)) {
             auto& target = component_manager_.get_component<TargetComponent>(entity);
             if (target.is_finished && target.is_target) {
                 std::cout << "find finished target: " << entity << std::endl;
                 entities.emplace_back(entity);
                 target.is_target = false;
-                //if target is a tree, it is finished
+                //if target is a tree or an emptied wood stack, it is finished
                 //it will be deleted
                 auto& type = component_manager_.get_component<RenderComponent>(entity).entityType;
-                if (type == EntityType::TREE) {
-                    std::cout << "tree " << entity << " will be deleted" << std::endl;
+                if (type == EntityType::TREE || type == EntityType::WOODPACK) {
+                    std::cout << "entity " << entity << " will be deleted" << std::endl;
                     component_manager_.get_component<TargetComponent>(entity).to_be_deleted = true;
-                } else if (type == EntityType::WOODPACK) {
-                    component_manager_.remove_component<TargetComponent>(entity);
+                    router_.invalidate_collision();
                 }
             }
         }
@@ -534,62 +710,184 @@ Entities TaskSystem::get_finished_target_entities() {
     return entities;
 }
 
-void TaskSystem::bind_resource_to_blueprint(Entity reso, Entity blueprint) {
-    resource_bind[blueprint] = reso;
-}
-
-Entity TaskSystem::find_exist_obtain_target(Entity blueprint) {
-    if (resource_bind.find(blueprint) != resource_bind.end())
-        return resource_bind[blueprint];
-    else
-        return -1;
-}
-
-bool TaskSystem::is_resoure_bound_to_blueprint(Entity reso) {
-    for(auto pair : resource_bind) {
-        if (pair.second == reso)
-            return true;
-    }
-    return false;
-}
-
 void TaskSystem::update_storage() {
-    for(auto pair : resource_bind) {
-        auto blueprint = pair.first;
-        auto& construction = component_manager_.get_component<ConstructionComponent>(blueprint);
-        if (construction.allocated) 
-            resource_bind.erase(blueprint);
-    }
+    close_finished_deliveries();
 
     for(auto& character : router_.get_characters()) {
         assert(component_manager_.has_component<TaskComponent>(character));
+        if (!router_.get_timers().on_turn(character, STORAGE_PERIOD))
+            continue;
         auto& task = component_manager_.get_component<TaskComponent>(character).current_task;
+        //characters on a haul plan or already storing know where they go, no need to search again
         if (character_carries_resource(character) 
             && task.type != TaskType::ALLOCATE
-            && task.type != TaskType::OBTAIN) {
+            && task.type != TaskType::OBTAIN
+            && task.type != TaskType::STORE
+            && haul_plans_.find(character) == haul_plans_.end()) {
             Entity storage_to_store;
-            bool any_to_store = find_resource_destination(character, storage_to_store, 0);
-            if (is_resoure_bound_to_blueprint(storage_to_store)) {
-                std::cout << "current storage " << storage_to_store << " is locked!" << std::endl;
-                any_to_store = false;
-            }
+            bool any_to_store = find_resource_destination(character, storage_to_store);
             if (any_to_store) {
                 std::cout << "character " << character << " to store at " << storage_to_store << std::endl;
-                if (!component_manager_.has_component<TargetComponent>(storage_to_store)) {
-                    component_manager_.add_component(storage_to_store, TargetComponent{
-                        .progress = 0,
-                        .is_target = true,
-                        .is_finished = false
-                    });
-                } else {
-                    component_manager_.get_component<TargetComponent>(storage_to_store).is_target = true;
-                    component_manager_.get_component<TargetComponent>(storage_to_store).is_finished = false;
-                }
+                raise_storage_target(storage_to_store);
             }
         }
     }
 }
 
+void TaskSystem::raise_storage_target(Entity storage) {
+    router_.get_target_events().push(storage, TargetEvent::STORAGE_RAISED);
+    if (!component_manager_.has_component<TargetComponent>(storage)) {
+        component_manager_.add_component(storage, TargetComponent{
+            .progress = 0,
+            .is_target = true,
+            .is_finished = false
+        });
+    } else {
+        component_manager_.get_component<TargetComponent>(storage).is_target = true;
+        component_manager_.get_component<TargetComponent>(storage).is_finished = false;
+    }
+}
+
+//the character was just given the seed collect task. loose stacks around it are claimed too,
+//until the bag is full, and visited in one route that ends next to the nearest storage.
+//every pickup after the first is handed out by continue_haul without going through the matching
+void TaskSystem::plan_haul(Entity character, TaskRegistry::Slot seed) {
+    auto& bag = component_manager_.get_component<StorageComponent>(character);
+    auto seed_task = tasks_.get(seed);
+    auto seed_loc = seed_task.target_locations[0];
+    auto stack_amount = [&](const Task& task) {
+        return component_manager_.get_component<ResourceComponent>(task.target_action.target_entity).amount;
+    };
+    int room = bag.storage_capacity - bag.current_storage - stack_amount(seed_task);
+
+    auto accept = [&](TaskRegistry::Slot slot) {
+        auto& task = tasks_.get(slot);
+        auto stack = task.target_action.target_entity;
+        return task.actor == -1 && router_.calculate_distance(seed_loc, task.target_locations[0]) <= HAUL_RADIUS
+            && entity_manager_.is_entity_alive(stack) && component_manager_.has_component<ResourceComponent>(stack)
+            && component_manager_.get_component<ResourceComponent>(stack).amount > 0;
+    };
+    //the last stack may only fit in part, the rest of it is left for another trip
+    std::vector<TaskRegistry::Slot> picks = {seed};
+    for (auto slot : tasks_.nearest_queued(seed_loc, HAUL_MAX_PICKS, accept, {TaskType::COLLECT})) {
+        if (room <= 0)
+            break;
+        room -= stack_amount(tasks_.get(slot));
+        picks.push_back(slot);
+    }
+
+    //one stop per stack, there is one stack per tile
+    Locations stops;
+    std::vector<int> ids;
+    for (auto slot : picks) {
+        stops.push_back(tasks_.get(slot).target_locations[0]);
+        ids.push_back(tasks_.get(slot).id);
+    }
+
+    //end at a storage tile with room left in the nearest stockpile zone
+    HaulPlan plan;
+    Location end;
+    plan.storage = router_.get_stockpiles().find_drop(seed_loc);
+    if (plan.storage != -1)
+        end = component_manager_.get_component<LocationComponent>(plan.storage).loc;
+
+    auto& start = component_manager_.get_component<LocationComponent>(character).loc;
+    auto route = HaulPlanner::order(start, stops, plan.storage == -1 ? nullptr : &end);
+    for (auto stop : route)
+        plan.pickups.push_back(ids[stop]);
+
+    for (auto slot : picks) {
+        tasks_.set_actor(slot, character);
+        tasks_.set_state(slot, TaskRegistry::State::IN_PROGRESS);
+    }
+    //the route may start somewhere else than the matched task
+    auto& cur_task = component_manager_.get_component<TaskComponent>(character).current_task;
+    cur_task = tasks_.get(tasks_.find(plan.pickups.front()));
+    plan.pickups.pop_front();
+    std::cout << "haul plan for " << character << ": " << stops.size() << " stacks, route length " << HaulPlanner::length(start, stops, route, plan.storage == -1 ? nullptr : &end)
+              << ", storage " << plan.storage << std::endl;
+    ++haul_stats_.plans;
+    haul_plans_[character] = std::move(plan);
+}
+
+//next pickup of the character's haul plan, or the store task at its end.
+//false if there is no plan or nothing left to do, the character then goes idle
+bool TaskSystem::continue_haul(Entity character, Task& cur_task) {
+    auto it = haul_plans_.find(character);
+    if (it == haul_plans_.end())
+        return false;
+    auto& plan = it->second;
+    auto& bag = component_manager_.get_component<StorageComponent>(character);
+    auto& pos = component_manager_.get_component<LocationComponent>(character).loc;
+    while (!plan.pickups.empty()) {
+        auto slot = tasks_.find(plan.pickups.front());
+        if (slot == TaskRegistry::NO_SLOT || tasks_.get(slot).actor != character) {
+            plan.pickups.pop_front();
+            continue;
+        }
+        auto& task = tasks_.get(slot);
+        auto stack = task.target_action.target_entity;
+        if (!entity_manager_.is_entity_alive(stack)
+            || component_manager_.get_component<ResourceComponent>(stack).amount == 0) {
+            plan.pickups.pop_front();
+            remove_task_from_progress_by_id(task.id);
+            continue;
+        }
+        //bag is full, the rest go back to queue
+        if (bag.storage_capacity - bag.current_storage <= 0)
+            break;
+        plan.pickups.pop_front();
+        cur_task = task;
+        ++haul_stats_.pickups;
+        if (task.target_locations[0] == pos)
+            ++haul_stats_.same_tile;
+        return true;
+    }
+
+    Entity storage = plan.storage;
+    release_haul_plan(character);
+    if (storage == -1 || !character_carries_resource(character) || !router_.get_stockpiles().has_room(storage))
+        return false;
+    if (!claim_store_task(character, storage, cur_task))
+        return false;
+    ++haul_stats_.deliveries;
+    return true;
+}
+
+//pickups the character will not do anymore go back to queue
+void TaskSystem::release_haul_plan(Entity character) {
+    auto it = haul_plans_.find(character);
+    if (it == haul_plans_.end())
+        return;
+    for (auto id : it->second.pickups) {
+        auto slot = tasks_.find(id);
+        if (slot != TaskRegistry::NO_SLOT && tasks_.get(slot).actor == character)
+            requeue_task(tasks_.get(slot));
+    }
+    haul_plans_.erase(it);
+}
+
+//store task at this storage for the character, false if someone else is already storing there
+bool TaskSystem::claim_store_task(Entity character, Entity storage, Task& cur_task) {
+    for (auto slot : tasks_.by_target(storage)) {
+        auto& task = tasks_.get(slot);
+        if (task.type != TaskType::STORE)
+            continue;
+        if (task.actor != -1 && task.actor != character)
+            return false;
+        tasks_.set_actor(slot, character);
+        tasks_.set_state(slot, TaskRegistry::State::IN_PROGRESS);
+        cur_task = tasks_.get(slot);
+        return true;
+    }
+    raise_storage_target(storage);
+    Task store = store_task(storage);
+    store.actor = character;
+    tasks_.add(store, TaskRegistry::State::IN_PROGRESS);
+    cur_task = store;
+    return true;
+}
+
 Task TaskSystem::empty_task() {
     return Task{
         .type = TaskType::EMPTY, 
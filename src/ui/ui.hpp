@@ -5,8 +5,20 @@
 #include <thread>
 #include <chrono>
 #include <iomanip>
+#include <sstream>
 #include <unordered_map>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include "utils/tripleBuffer.hpp"
+
+//frames slower than this don't make the simulation catch up any further
+#define MAX_FRAME_SECONDS 0.25f
+#define MAX_TICKS_PER_FRAME 8
+//game speeds are ticks of game time per tick of real time, max runs as many as the frame allows
+#define SPEED_MAX 0
+//share of a frame max speed may spend simulating, the rest is left for drawing
+#define MAX_SPEED_FRAME_SHARE 0.8f
 
 enum class GameState { Start, In, End };
 class Message {
@@ -411,7 +423,7 @@ class UI {
     int window_width_;
     int window_height_;
     sf::RenderWindow window;
-    int frame_rate_;
+    int frame_rate_ = FRAMERATE;
     sf::Font font;
 
     //some menu thing
@@ -429,6 +441,22 @@ class UI {
     std::unordered_map<Location, int> wood_count;
     bool is_selecting = false;
     bool is_game_paused = false;
+    float interpolation_ = 1.0f; //how far drawing is between the last two ticks
+    int speed_ = 1; //1x, 2x, 3x or SPEED_MAX
+
+    //simulation thread. it owns the world while it ticks. input sends player commands through
+    //the world's lock-free queue; world_mutex_ only guards starting, loading and saving a world
+    //and the pause and speed state the simulation reads. drawing only reads snapshots_
+    std::thread sim_thread_;
+    std::atomic<bool> sim_running_{false};
+    std::mutex world_mutex_;
+    TripleBuffer<RenderSnapshot> snapshots_;
+    float tick_accumulator_ = 0.0f; //game time not simulated yet, in seconds
+    int round_ = 0;
+    //achieved ticks per second, measured over about a second
+    sf::Clock tps_clock_;
+    int tps_ticks_ = 0;
+    std::atomic<float> tps_{0.0f};
     
     //camara thing
     sf::View gameView;
@@ -481,8 +509,8 @@ public:
     void run() {
         std::cout << "running UI" << std::endl;
         sf::Clock clock;
-        float deltaTime = 0.0f;
-        int round = 0;
+        sim_running_ = true;
+        sim_thread_ = std::thread(&UI::run_simulation, this);
         while (window.isOpen()) {
             handleEvents(clock);
 
@@ -492,9 +520,8 @@ public:
                     break;
                 }
                 case GameState::In: {
+                    show_command_results();
                     if( !is_game_paused ) {
-                        std::cout << "\n\n-----Round " << ++round << std::endl;
-                        world_ -> update_world();
                         draw_in(true);
                     }
                     break;
@@ -509,30 +536,126 @@ public:
 
             //std::this_thread::sleep_for(std::chrono::milliseconds(20));
         }
+        sim_running_ = false;
+        sim_thread_.join();
     }
 
 private:
+    //simulation thread: fixed ticks at the chosen speed, a snapshot after each batch
+    void run_simulation() {
+        sf::Clock frame_clock;
+        const float tick_seconds = 1.0f / FRAMERATE;
+        while (sim_running_) {
+            float frame_seconds = std::min(frame_clock.restart().asSeconds(), MAX_FRAME_SECONDS);
+            float wait_seconds = tick_seconds;
+            bool max_speed = false;
+            {
+                std::lock_guard<std::mutex> lock(world_mutex_);
+                if (game_state != GameState::In || is_game_paused || !world_) {
+                    tick_accumulator_ = 0.0f;
+                } else if (speed_ == SPEED_MAX) {
+                    max_speed = true;
+                } else {
+                    //the world advances in fixed ticks whatever the frame rate,
+                    //with a cap so a slow batch can't start a spiral of ever longer catch ups.
+                    //at 2x and 3x the same real time covers that much more game time
+                    tick_accumulator_ += frame_seconds * speed_;
+                    int ticks = 0;
+                    int max_ticks = MAX_TICKS_PER_FRAME * speed_;
+                    while (tick_accumulator_ >= tick_seconds && ticks < max_ticks) {
+                        tick_world();
+                        tick_accumulator_ -= tick_seconds;
+                        ++ticks;
+                    }
+                    if (ticks == max_ticks)
+                        tick_accumulator_ = std::min(tick_accumulator_, tick_seconds);
+                    if (ticks > 0)
+                        publish_snapshot();
+                    wait_seconds = (tick_seconds - tick_accumulator_) / speed_;
+                }
+            }
+            if (max_speed)
+                wait_seconds = run_max_speed_frame();
+            if (wait_seconds > 0)
+                std::this_thread::sleep_for(std::chrono::duration<float>(wait_seconds));
+        }
+    }
+
+    //as many ticks as fit in MAX_SPEED_FRAME_SHARE of a display frame, only the last one is drawn.
+    //the lock is taken per tick and the thread yields in between, so input, speed changes and
+    //saving get in within a tick. returns the rest of the frame, left to the render thread
+    float run_max_speed_frame() {
+        sf::Clock budget;
+        float frame_seconds = 1.0f / frame_rate_;
+        float frame_budget = MAX_SPEED_FRAME_SHARE * frame_seconds;
+        bool ticked = false;
+        while (budget.getElapsedTime().asSeconds() < frame_budget) {
+            {
+                std::lock_guard<std::mutex> lock(world_mutex_);
+                if (game_state != GameState::In || is_game_paused || !world_ || speed_ != SPEED_MAX)
+                    break;
+                tick_world();
+                ticked = true;
+            }
+            std::this_thread::yield();
+        }
+        {
+            std::lock_guard<std::mutex> lock(world_mutex_);
+            tick_accumulator_ = 0.0f;
+            if (ticked && world_)
+                publish_snapshot();
+        }
+        return frame_seconds - budget.getElapsedTime().asSeconds();
+    }
+
+    void tick_world() {
+        std::cout << "\n\n-----Round " << ++round_ << std::endl;
+        world_ -> update_world();
+        ++tps_ticks_;
+        float elapsed = tps_clock_.getElapsedTime().asSeconds();
+        if (elapsed >= 1.0f) {
+            tps_ = tps_ticks_ / elapsed;
+            tps_ticks_ = 0;
+            tps_clock_.restart();
+        }
+    }
+
+    void publish_snapshot() {
+        auto& snapshot = snapshots_.back();
+        world_ -> fill_snapshot(snapshot);
+        snapshot.published = std::chrono::steady_clock::now();
+        snapshots_.publish();
+    }
+
+    void set_speed(int speed) {
+        std::lock_guard<std::mutex> lock(world_mutex_);
+        speed_ = speed;
+        tick_accumulator_ = 0.0f;
+        msg.showMessage(speed == SPEED_MAX ? "Speed: max" : "Speed: " + std::to_string(speed) + "x");
+    }
+
     void set_up_button(sf::RectangleShape& btn, std::string text, sf::Vector2f pos, sf::Vector2f size);
     void draw_start();
     void draw_in(bool background);
     void draw_end();
-    void draw_entity(Entity entity);
+    void draw_entity(const RenderItem& item, float render_x, float render_y);
     void drawGrid();
-    void drawEntity(Entity entity);
-    void drawMark(Entity entity);
-    void drawWoodsHeld(Entity entity);
-    void drawWoodsDropped();
-    void drawTask(Entity entity);
+    void drawMark(const RenderItem& item);
+    void drawWoodsHeld(const RenderItem& item);
+    void drawWoodsDropped(const RenderSnapshot& snapshot);
+    void drawTask(const RenderItem& item);
     void drawWoodtext(std::string wood_text, Location loc);
     void drawOneWood(Location loc);
-    void drawProcess(Entity entity); //entity is a target
-    void update_dropped_woods();
+    void drawProcess(const RenderItem& item); //item is a target
+    void update_dropped_woods(const RenderSnapshot& snapshot);
     float smoothstep(float x);
     float lerp(int a, int b, float t);
     void drawSelectionHighlight(float x, float y);
+    void drawSpeed();
 
     void startNewGame() {
         std::cout << "try start new game" << std::endl;
+        std::lock_guard<std::mutex> lock(world_mutex_);
         world_ = std::make_unique<World>();
         game_state = GameState::In;
         std::cout << "try set view to game world view" << std::endl;
@@ -542,6 +665,7 @@ private:
     void loadExistingGame() {
         try {
             std::cout << "try load existing game" << std::endl;
+            std::lock_guard<std::mutex> lock(world_mutex_);
             world_ = std::make_unique<World>();
             world_->load_world();
             game_state = GameState::In;
@@ -551,6 +675,7 @@ private:
     }
 
     void save_and_exit() {
+        std::lock_guard<std::mutex> lock(world_mutex_);
         world_ -> save_world();
         window.close();
     }
@@ -560,31 +685,43 @@ private:
         return render.is_selected;
     }
 
-    void unselect_all_entities() {
-        for(auto& entity : world_ -> get_all_entities()) {
-            if (!world_ -> component_manager_.has_component<RenderComponent>(entity)) {
-                continue;
+    //world commands are applied by the simulation at the start of its next tick
+    void send_command(CommandType type, Location start = Location{}, Location end = Location{}) {
+        world_ -> push_command(PlayerCommand{type, start, end});
+    }
+
+    //messages for the commands the simulation has applied since the last frame
+    void show_command_results() {
+        world_ -> get_command_results().drain([this](CommandResult& result) {
+            switch (result.type) {
+                case CommandType::MAKE_STORAGE:
+                    msg.showMessage(result.ok ? "Storage area built" : "Storage construction failed");
+                    break;
+                case CommandType::MARK_TREES:
+                    msg.showMessage(result.ok ? "Trees marked" : "No trees to mark");
+                    break;
+                case CommandType::UNMARK_TREES:
+                    msg.showMessage(result.ok ? "Mark canceled!" : "No marks");
+                    break;
+                case CommandType::SET_DOOR:
+                    msg.showMessage(result.ok ? "Door blueprint has been set" : "Door blueprint construction failed");
+                    break;
+                case CommandType::SET_WALL:
+                    msg.showMessage(result.ok ? "Wall blueprint has been set" : "Wall blueprint construction failed");
+                    break;
+                default:
+                    break;
             }
-            auto& render = world_ -> component_manager_.get_component<RenderComponent>(entity);
-            render.is_selected = false;
-        }
+        });
     }
 
-    void select_entities_in_area(sf::Vector2i start, sf::Vector2i end, bool select) {
-        int minX = std::min(start.x, end.x) / TILE_SIZE;
-        int maxX = std::max(start.x, end.x) / TILE_SIZE;
-        int minY = std::min(start.y, end.y) / TILE_SIZE;
-        int maxY = std::max(start.y, end.y) / TILE_SIZE;
-        
-        for(auto& entity : world_ -> get_all_entities()) {
-            if (!world_ -> component_manager_.has_component<RenderComponent>(entity))
-                continue;
-            auto& render = world_ -> component_manager_.get_component<RenderComponent>(entity);
-            auto& loc = world_ -> component_manager_.get_component<LocationComponent>(entity).loc;
-            
-            if (loc.x >= minX && loc.x <= maxX && loc.y >= minY && loc.y <= maxY)
-                render.is_selected = select;
-        }
+    void unselect_all_entities() {
+        send_command(CommandType::UNSELECT_ALL);
+    }
+
+    void select_entities_in_area(sf::Vector2i start, sf::Vector2i end) {
+        send_command(CommandType::SELECT_AREA,
+            Location{start.x / TILE_SIZE, start.y / TILE_SIZE}, Location{end.x / TILE_SIZE, end.y / TILE_SIZE});
     }
 
     void handleEvents(sf::Clock& clock) {
@@ -659,6 +796,7 @@ private:
 
         if (event.type == sf::Event::KeyPressed) {
             if (event.key.code == sf::Keyboard::Escape) {
+                std::lock_guard<std::mutex> lock(world_mutex_);
                 game_state = GameState::In;
                 is_game_paused = false;
             }
@@ -705,7 +843,7 @@ private:
         if (event.mouseButton.button == sf::Mouse::Left) {
             is_selecting = false;
             mouseCurrentPos = sf::Mouse::getPosition(window);
-            select_entities_in_area(mousePressedPos, mouseCurrentPos, true);
+            select_entities_in_area(mousePressedPos, mouseCurrentPos);
             
             if (!selectionMenu.isVisible())
                 selectionMenu.show(mouseCurrentPos);
@@ -719,24 +857,15 @@ private:
             std::cout << "Building storage area..." << std::endl;
             Location start = {mousePressedPos.x / TILE_SIZE, mousePressedPos.y / TILE_SIZE};
             Location end = {mouseCurrentPos.x / TILE_SIZE, mouseCurrentPos.y / TILE_SIZE};
-            if(world_ -> make_storage_area(start, end))
-                msg.showMessage("Storage area built");
-            else 
-                msg.showMessage("Storage construction failed");
+            send_command(CommandType::MAKE_STORAGE, start, end);
         }
         else if (selectionMenu.isMarkTreesClicked(mousePos)) {
             std::cout << "Marking trees..." << std::endl;
-            if (world_ -> mark_tree(true))
-                msg.showMessage("Trees marked");
-            else 
-                msg.showMessage("No trees to mark");
+            send_command(CommandType::MARK_TREES);
         }
         else if (selectionMenu.isMarkTreesClicked(mousePos)) {
             std::cout << "Unmarking trees..." << std::endl;
-            if (world_ -> mark_tree(false))
-                msg.showMessage("Mark canceled!");
-            else 
-                msg.showMessage("No marks");
+            send_command(CommandType::UNMARK_TREES);
         }
         
         selectionMenu.hide();
@@ -747,17 +876,11 @@ private:
         
         if (buildMenu.isBuildDoorClicked(mousePos)) {
             std::cout << "Building door..." << std::endl;
-            if (world_ -> set_door_blueprint(buildPos)) 
-                msg.showMessage("Door blueprint has been set");
-            else 
-                msg.showMessage("Door blueprint construction failed");
+            send_command(CommandType::SET_DOOR, buildPos);
         }
         else if (buildMenu.isBuildWallClicked(mousePos)) {
             std::cout << "Building wall..." << std::endl;
-            if (world_ -> set_wall_blueprint(buildPos))
-                msg.showMessage("Wall blueprint has been set");
-            else
-                msg.showMessage("Wall blueprint construction failed");
+            send_command(CommandType::SET_WALL, buildPos);
         }
         
         buildMenu.hide();
@@ -770,44 +893,48 @@ private:
                 break;
             }
             case sf::Keyboard::Escape: {
+                std::lock_guard<std::mutex> lock(world_mutex_);
                 is_game_paused = true;
                 game_state = GameState::End;
                 break;
             }
             case sf::Keyboard::Space: {
+                std::lock_guard<std::mutex> lock(world_mutex_);
                 is_game_paused = !is_game_paused;
                 std::cout << (is_game_paused ? "game pause!" : "game continue!") << std::endl;
                 break;
             }
+            //game speed: F1 1x, F2 2x, F3 3x, F4 max
+            case sf::Keyboard::F1:
+            case sf::Keyboard::F2:
+            case sf::Keyboard::F3: {
+                set_speed(1 + (key - sf::Keyboard::F1));
+                break;
+            }
+            case sf::Keyboard::F4: {
+                set_speed(SPEED_MAX);
+                break;
+            }
             case sf::Keyboard::Num1: {
                 if (selectionMenu.isVisible()) {
                     std::cout << "Building storage area..." << std::endl;
                     Location start = {mousePressedPos.x / TILE_SIZE, mousePressedPos.y / TILE_SIZE};
                     Location end = {mouseCurrentPos.x / TILE_SIZE, mouseCurrentPos.y / TILE_SIZE};
-                    if(world_ -> make_storage_area(start, end))
-                        msg.showMessage("Storage area built");
-                    else 
-                        msg.showMessage("Storage construction failed");
+                    send_command(CommandType::MAKE_STORAGE, start, end);
                 }
                 break;
             }
             case sf::Keyboard::Num2: {
                 if (selectionMenu.isVisible()) {
                     std::cout << "Marking trees..." << std::endl;
-                    if (world_ -> mark_tree(true))
-                        msg.showMessage("Trees marked");
-                    else 
-                        msg.showMessage("No trees to mark");
+                    send_command(CommandType::MARK_TREES);
                 }
                 break;
             }
             case sf::Keyboard::Num3: {
                 if (selectionMenu.isVisible()) {
                     std::cout << "Unmarking trees..." << std::endl;
-                    if (world_ -> mark_tree(false))
-                        msg.showMessage("Mark canceled!");
-                    else 
-                    msg.showMessage("No marks");
+                    send_command(CommandType::UNMARK_TREES);
                 }
                 break;
             }
@@ -815,22 +942,16 @@ private:
                 if (buildMenu.isVisible()) {
                     std::cout << "Building door..." << std::endl;
                     Location loc = {mouseCurrentPos.x / TILE_SIZE, mouseCurrentPos.y / TILE_SIZE};
-                    if (world_ -> set_door_blueprint(loc)) 
-                        msg.showMessage("Door blueprint has been set");
-                    else 
-                        msg.showMessage("Door blueprint construction failed");
-                    }
+                    send_command(CommandType::SET_DOOR, loc);
+                }
                 break;
             }
             case sf::Keyboard::Num5: {
                 if (buildMenu.isVisible()) {
                     std::cout << "Building wall..." << std::endl;
                     Location loc = {mouseCurrentPos.x / TILE_SIZE, mouseCurrentPos.y / TILE_SIZE};
-                    if (world_ -> set_wall_blueprint(loc))
-                        msg.showMessage("Wall blueprint has been set");
-                    else
-                        msg.showMessage("Wall blueprint construction failed");
-                    }
+                    send_command(CommandType::SET_WALL, loc);
+                }
                 break;
             }
             default:
@@ -943,37 +1064,17 @@ void UI::drawGrid() {
     }
 }
 
-//HERE entity is character or storage or blueprint
-void UI::drawWoodsHeld(Entity entity) {
+//HERE item is character or storage or blueprint
+void UI::drawWoodsHeld(const RenderItem& item) {
     std::string info;
-
-    if(!world_ -> component_manager_.has_component<RenderComponent>(entity)) {
-        return;
-    }
-    int amount = 0;
-    auto& type = world_ -> component_manager_.get_component<RenderComponent>(entity).entityType;
-    if (type == EntityType::STORAGE || type == EntityType::CHARACTER ) {
-        if (!world_ -> component_manager_.has_component<StorageComponent>(entity)) {
-            return;
-        }
-        auto& storage = world_ -> component_manager_.get_component<StorageComponent>(entity);
-        amount = storage.current_storage;
+    int amount = item.held;
+    if (item.type == EntityType::STORAGE || item.type == EntityType::CHARACTER ) {
         info = "Holding: " + std::to_string(amount);
-    } else if (type == EntityType::WALL || type == EntityType::DOOR) {
-        if(!world_ -> component_manager_.has_component<ConstructionComponent>(entity)) {
-            return;
-        }
-        auto& construction = world_ -> component_manager_.get_component<ConstructionComponent>(entity);
-        if (construction.is_built) {
+    } else if (item.type == EntityType::WALL || item.type == EntityType::DOOR) {
+        if (!item.blueprint) {
             return;
         } else {//still a blueprint
-            if (!world_ -> component_manager_.has_component<StorageComponent>(entity)) {
-                return;
-            }
-            auto& storage = world_ -> component_manager_.get_component<StorageComponent>(entity);
-            amount = storage.current_storage;
-            int target_amount = storage.storage_capacity;
-            info = "Allocated: " + std::to_string(amount) + " / " + std::to_string(target_amount);
+            info = "Allocated: " + std::to_string(amount) + " / " + std::to_string(item.capacity);
         }
     } else {
         return;
@@ -983,17 +1084,16 @@ void UI::drawWoodsHeld(Entity entity) {
         return;
     } 
 
-    auto loc = world_ -> component_manager_.get_component<LocationComponent>(entity).loc;
-    drawOneWood(loc);
-    drawWoodtext(info, loc);
+    drawOneWood(item.loc);
+    drawWoodtext(info, item.loc);
 }
 
-void UI::drawWoodsDropped() {
-    update_dropped_woods();
+void UI::drawWoodsDropped(const RenderSnapshot& snapshot) {
+    update_dropped_woods(snapshot);
     for(auto& pair : wood_count) {
         Location loc = pair.first;
         int amount = pair.second;
-        auto wood_text = "Dropped: " + std::to_string(amount * 5);
+        auto wood_text = "Dropped: " + std::to_string(amount);
         if (amount > 0) {
             drawOneWood(loc);
             drawWoodtext(wood_text, loc);
@@ -1001,14 +1101,9 @@ void UI::drawWoodsDropped() {
     }
 }
 
-void UI::drawMark(Entity entity) {
-    if(!world_ -> component_manager_.has_component<TargetComponent>(entity)) {
-        return;
-    }
-
-    auto& target = world_ -> component_manager_.get_component<TargetComponent>(entity);
-    if (target.is_target) {
-        auto& pos = world_ -> component_manager_.get_component<LocationComponent>(entity).loc;
+void UI::drawMark(const RenderItem& item) {
+    if (item.marked) {
+        auto& pos = item.loc;
         float screen_x = pos.x * TILE_SIZE;
         float screen_y = pos.y * TILE_SIZE;
         std::cout << "mark tree at " << pos.x << ", " << pos.y << std::endl;
@@ -1021,14 +1116,9 @@ void UI::drawMark(Entity entity) {
     }
 }
 
-void UI::drawTask(Entity entity) {
-    if(!world_ -> component_manager_.has_component<TaskComponent>(entity)) {
-        return;
-    }
-
-    auto& task = world_ -> component_manager_.get_component<TaskComponent>(entity).current_task;
-    auto& type = task.type;
-    auto& pos = world_ -> component_manager_.get_component<LocationComponent>(entity).loc;
+void UI::drawTask(const RenderItem& item) {
+    auto& type = item.task;
+    auto& pos = item.loc;
     std::string task_str = "";
     switch(type) {
         case TaskType::CHOP_WOOD: {
@@ -1085,6 +1175,23 @@ void UI::drawWoodtext(std::string wood_text, Location loc) {
     window.draw(info);
 }
 
+//speed and achieved ticks per second, in the top left corner of the window
+void UI::drawSpeed() {
+    sf::Text info;
+    info.setFont(font);
+    info.setCharacterSize(TILE_SIZE / 2);
+    std::ostringstream text;
+    text << (speed_ == SPEED_MAX ? std::string("max") : std::to_string(speed_) + "x")
+         << "  " << std::fixed << std::setprecision(0) << tps_ << " ticks/s";
+    info.setString(text.str());
+    info.setFillColor(sf::Color::Black);
+    info.setPosition(10, 10);
+    auto view = window.getView();
+    window.setView(window.getDefaultView());
+    window.draw(info);
+    window.setView(view);
+}
+
 void UI::drawOneWood(Location loc) {
     sf::Texture wood_texture;
     wood_texture.loadFromFile("../resources/images/woodpack.png");
@@ -1098,19 +1205,17 @@ void UI::drawOneWood(Location loc) {
     window.draw(wood);
 }
 
-void UI::drawProcess(Entity entity) {
-    if (!world_ -> component_manager_.has_component<TargetComponent>(entity))
-        return;
-    auto &target = world_ -> component_manager_.get_component<TargetComponent>(entity);
-    if (!target.is_target || target.progress == 0 || target.progress >= 100) 
+void UI::drawProcess(const RenderItem& item) {
+    float progress = item.work_progress;
+    if (!item.marked || progress == 0 || progress >= 100) 
         return;
-    auto loc = world_ -> component_manager_.get_component<LocationComponent>(entity).loc;
+    auto loc = item.loc;
     float bar_width = 1.5 * TILE_SIZE;
     float bar_height = 0.25 * TILE_SIZE;
     sf::RectangleShape background(sf::Vector2f(bar_width, bar_height));
     background.setFillColor(sf::Color::Black);
     background.setPosition(loc.x * TILE_SIZE - TILE_SIZE / 4, loc.y * TILE_SIZE + TILE_SIZE); 
-    float p = target.progress / 100.0;
+    float p = progress / 100.0;
     sf::RectangleShape foreground(sf::Vector2f(p * bar_width, bar_height));
     foreground.setFillColor(sf::Color::Green);
     foreground.setPosition(loc.x * TILE_SIZE - TILE_SIZE / 4, loc.y * TILE_SIZE + TILE_SIZE); 
@@ -1119,29 +1224,11 @@ void UI::drawProcess(Entity entity) {
     window.draw(foreground);
 }
 
-void UI::update_dropped_woods() {
+void UI::update_dropped_woods(const RenderSnapshot& snapshot) {
     wood_count.clear();
-    for(auto& entity : world_ -> get_all_entities()) {
-        if (!world_ -> component_manager_.has_component<RenderComponent>(entity)) 
-            continue;
-        auto& render = world_ -> component_manager_.get_component<RenderComponent>(entity);
-
-        if (render.entityType == EntityType::WOODPACK 
-        && world_ -> component_manager_.has_component<ResourceComponent>(entity)
-        && world_ -> component_manager_.has_component<TargetComponent>(entity)) {
-            if (!world_ -> component_manager_.get_component<TargetComponent>(entity).is_target
-            || world_ -> component_manager_.get_component<ResourceComponent>(entity).holder != -1) {
-                continue;
-            }
-
-            auto& loc = world_ -> component_manager_.get_component<LocationComponent>(entity).loc;
-            if (wood_count.find(loc) == wood_count.end()) {
-                wood_count[loc] = 1;
-            } else {
-                wood_count[loc]++;
-            }
-        }
-    }
+    //one stack per tile, its amount is the number of woods
+    for(auto& [loc, amount] : snapshot.dropped)
+        wood_count[loc] += amount;
 }
 
 float UI::smoothstep(float x) { 
@@ -1238,11 +1325,36 @@ void UI::draw_in(bool background) {
         //drawWoodsDropped();
         //here i dividely draw woods that are dropped and held by some entities
         //and for efficiency, only draw one of them at a time
-    for(auto& entity : world_ -> get_all_entities()) {
-        draw_entity(entity);
+    snapshots_.update();
+    auto& snapshot = snapshots_.front();
+    //draw between the previous tick and the snapshot's, by the real time since it was published
+    if (speed_ == SPEED_MAX) {
+        interpolation_ = 1.0f;
+    } else {
+        std::chrono::duration<float> since = std::chrono::steady_clock::now() - snapshot.published;
+        interpolation_ = std::min(since.count() * speed_ * FRAMERATE, 1.0f);
+    }
+    for(auto& item : snapshot.items) {
+        float render_x = static_cast<float>(item.loc.x) * TILE_SIZE;
+        float render_y = static_cast<float>(item.loc.y) * TILE_SIZE;
+        if (item.progress >= 0) {
+            float t = smoothstep(item.progress);
+            float bounce = sin(item.progress * M_PI) * 4.0f;
+            render_x = lerp(item.start_pos.x, item.end_pos.x, t) * TILE_SIZE - bounce;
+            render_y = lerp(item.start_pos.y, item.end_pos.y, t) * TILE_SIZE;
+            if (item.prev_progress >= 0) {
+                float prev_t = smoothstep(item.prev_progress);
+                float prev_bounce = sin(item.prev_progress * M_PI) * 4.0f;
+                float prev_x = lerp(item.prev_start_pos.x, item.prev_end_pos.x, prev_t) * TILE_SIZE - prev_bounce;
+                float prev_y = lerp(item.prev_start_pos.y, item.prev_end_pos.y, prev_t) * TILE_SIZE;
+                render_x = prev_x + (render_x - prev_x) * interpolation_;
+                render_y = prev_y + (render_y - prev_y) * interpolation_;
+            }
+        }
+        draw_entity(item, render_x, render_y);
     }
 
-    drawWoodsDropped();
+    drawWoodsDropped(snapshot);
 
     if (is_selecting) {
         mouseCurrentPos = sf::Mouse::getPosition(window);
@@ -1263,42 +1375,26 @@ void UI::draw_in(bool background) {
     msg.draw();
     selectionMenu.draw();
     buildMenu.draw();
+    drawSpeed();
 
 
 }
 
-void UI::draw_entity(Entity entity) {
-    if (!world_ -> component_manager_.has_component<RenderComponent>(entity)) {
-        return;        }
-    auto& render = world_ -> component_manager_.get_component<RenderComponent>(entity);
+void UI::draw_entity(const RenderItem& item, float render_x, float render_y) {
     sf::Sprite sprite;
 
-    auto& loc = world_ -> component_manager_.get_component<LocationComponent>(entity).loc;
-    float render_x = static_cast<float>(loc.x) * TILE_SIZE;
-    float render_y = static_cast<float>(loc.y) * TILE_SIZE;
-
-    if (world_ -> component_manager_.has_component<MovementComponent>(entity)) {
-        auto& movement = world_ -> component_manager_.get_component<MovementComponent>(entity);
-        float t = smoothstep(movement.progress);
-        std::cout << "progress: " << movement.progress << ", t: " << t << std::endl;
-        float bounce = sin(movement.progress * M_PI) * 4.0f;
-        render_x = lerp(movement.start_pos.x, movement.end_pos.x, t) * TILE_SIZE - bounce;
-        render_y = lerp(movement.start_pos.y, movement.end_pos.y, t) * TILE_SIZE;
-    } 
-
         //draw_location(entity);
         
-    switch (render.entityType) {
+    switch (item.type) {
         case EntityType::TREE: {
             sf::Texture tree_texture;
             if (!tree_texture.loadFromFile("../resources/images/tree.png")) std::cerr << "Failed to load tree texture" << std::endl;
             sprite.setTexture(tree_texture);
-            auto& loc = world_ -> component_manager_.get_component<LocationComponent>(entity).loc;
             sprite.setPosition(render_x - TILE_SIZE / 8, render_y - TILE_SIZE / 2);
             sprite.setScale(0.25f, 0.25f);
             window.draw(sprite);
-            drawMark(entity);
-            drawProcess(entity);
+            drawMark(item);
+            drawProcess(item);
             break;
         }
         case EntityType::CHARACTER: {
@@ -1308,8 +1404,8 @@ void UI::draw_entity(Entity entity) {
             sprite.setPosition(render_x, render_y);
             sprite.setScale(0.5f, 0.5f);
             window.draw(sprite);
-            drawTask(entity);
-            drawWoodsHeld(entity);
+            drawTask(item);
+            drawWoodsHeld(item);
             break;
         }
         case EntityType::DOG: {
@@ -1319,7 +1415,7 @@ void UI::draw_entity(Entity entity) {
             sprite.setPosition(render_x, render_y);
             sprite.setScale(0.5f, 0.5f);
             window.draw(sprite);
-            //drawTask(entity);
+            //drawTask(item);
             break;
         }
         case EntityType::DOOR: {
@@ -1328,15 +1424,14 @@ void UI::draw_entity(Entity entity) {
             sprite.setTexture(door_texture);
             sprite.setPosition(render_x + 4, render_y - 8);
             sprite.setScale(0.2f, 0.2f);
-            auto& construction = world_ -> component_manager_.get_component<ConstructionComponent>(entity);
-            if (!construction.is_built) {
-                drawWoodsHeld(entity);
+            if (item.blueprint) {
+                drawWoodsHeld(item);
                 sf::Color color = sprite.getColor();
                 color.a = 64;
                 sprite.setColor(color);
             }
             window.draw(sprite);
-            drawProcess(entity);
+            drawProcess(item);
             break;
         }
         case EntityType::WALL: {
@@ -1345,15 +1440,14 @@ void UI::draw_entity(Entity entity) {
             sprite.setTexture(wall_texture);
             sprite.setPosition(render_x, render_y);
             sprite.setScale(0.6f, 0.6f);
-            auto& construction = world_ -> component_manager_.get_component<ConstructionComponent>(entity);
-            if (!construction.is_built) {
-                drawWoodsHeld(entity);
+            if (item.blueprint) {
+                drawWoodsHeld(item);
                 sf::Color color = sprite.getColor();
                 color.a = 64;
                 sprite.setColor(color);
             }
             window.draw(sprite);
-            drawProcess(entity);
+            drawProcess(item);
             break;
         }
         case EntityType::STORAGE: {
@@ -1366,8 +1460,8 @@ void UI::draw_entity(Entity entity) {
             color.a = 140;
             sprite.setColor(color);
             window.draw(sprite);
-            drawWoodsHeld(entity);
-            drawProcess(entity);
+            drawWoodsHeld(item);
+            drawProcess(item);
             break;
         }
             /* aborted: draw wood pack
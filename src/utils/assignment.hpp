@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <iostream>
+
+//pairs that must not be matched get this cost, kept finite so the potentials stay finite
+#define ASSIGN_FORBIDDEN 1e12
+//above this many (row, column) pairs the exact matching is too slow for one tick, use greedy
+#define ASSIGN_EXACT_LIMIT 200000
+
+//one-to-one assignment of rows (e.g. workers) to columns (e.g. tasks) with minimal total cost
+//result[row] is the matched column, or -1 if the row stays unmatched (or only forbidden pairs were left)
+class Assignment {
+    //hungarian algorithm with potentials, O(n^2 * m), needs n <= m
+    static std::vector<int> hungarian(const std::vector<std::vector<double>>& cost) {
+        int n = static_cast<int>(cost.size());
+        int m = static_cast<int>(cost[0].size());
+        const double inf = std::numeric_limits<double>::max();
+        std::vector<double> u(n + 1, 0), v(m + 1, 0);
+        std::vector<int> p(m + 1, 0), way(m + 1, 0);
+        for (int i = 1; i <= n; ++i) {
+            p[0] = i;
+            int j0 = 0;
+            std::vector<double> minv(m + 1, inf);
+            std::vector<bool> used(m + 1, false);
+            do {
+                used[j0] = true;
+                int i0 = p[j0], j1 = 0;
+                double delta = inf;
+                for (int j = 1; j <= m; ++j) {
+                    if (used[j])
+                        continue;
+                    double cur = cost[i0 - 1][j - 1] - u[i0] - v[j];
+                    if (cur < minv[j]) {
+                        minv[j] = cur;
+                        way[j] = j0;
+                    }
+                    if (minv[j] < delta) {
+                        delta = minv[j];
+                        j1 = j;
+                    }
+                }
+                for (int j = 0; j <= m; ++j) {
+                    if (used[j]) {
+                        u[p[j]] += delta;
+                        v[j] -= delta;
+                    } else {
+                        minv[j] -= delta;
+                    }
+                }
+                j0 = j1;
+            } while (p[j0] != 0);
+            //flip the augmenting path
+            do {
+                int j1 = way[j0];
+                p[j0] = p[j1];
+                j0 = j1;
+            } while (j0);
+        }
+
+        std::vector<int> result(n, -1);
+        for (int j = 1; j <= m; ++j)
+            if (p[j] != 0)
+                result[p[j] - 1] = j - 1;
+        return result;
+    }
+
+    static std::vector<std::vector<double>> transpose(const std::vector<std::vector<double>>& cost) {
+        std::vector<std::vector<double>> t(cost[0].size(), std::vector<double>(cost.size()));
+        for (size_t i = 0; i < cost.size(); ++i)
+            for (size_t j = 0; j < cost[i].size(); ++j)
+                t[j][i] = cost[i][j];
+        return t;
+    }
+
+public:
+    static std::vector<int> solve(const std::vector<std::vector<double>>& cost) {
+        if (cost.empty() || cost[0].empty())
+            return std::vector<int>(cost.size(), -1);
+        size_t n = cost.size(), m = cost[0].size();
+        if (n * m > ASSIGN_EXACT_LIMIT) {
+            std::cout << "assignment: " << n << " x " << m << " too large, use greedy" << std::endl;
+            return greedy(cost);
+        }
+
+        std::vector<int> result;
+        if (n <= m) {
+            result = hungarian(cost);
+        } else {
+            //more rows than columns: match columns to rows instead
+            auto by_column = hungarian(transpose(cost));
+            result.assign(n, -1);
+            for (size_t j = 0; j < by_column.size(); ++j)
+                if (by_column[j] != -1)
+                    result[by_column[j]] = static_cast<int>(j);
+        }
+        for (size_t i = 0; i < n; ++i)
+            if (result[i] != -1 && cost[i][result[i]] >= ASSIGN_FORBIDDEN)
+                result[i] = -1;
+        return result;
+    }
+
+    //each row in turn takes its cheapest free column, O(n * m)
+    static std::vector<int> greedy(const std::vector<std::vector<double>>& cost) {
+        std::vector<int> result(cost.size(), -1);
+        if (cost.empty())
+            return result;
+        std::vector<bool> taken(cost[0].size(), false);
+        for (size_t i = 0; i < cost.size(); ++i) {
+            double best = ASSIGN_FORBIDDEN;
+            for (size_t j = 0; j < cost[i].size(); ++j) {
+                if (!taken[j] && cost[i][j] < best) {
+                    best = cost[i][j];
+                    result[i] = static_cast<int>(j);
+                }
+            }
+            if (result[i] != -1)
+                taken[result[i]] = true;
+        }
+        return result;
+    }
+};
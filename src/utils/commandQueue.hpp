@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include "../components/component.hpp"
+
+//lock-free queue for many producers and one consumer. push() links a node onto a stack with
+//one compare and swap; drain() takes the whole stack with one exchange and hands it out oldest
+//first. the consumer never takes single nodes, so there is no ABA problem. a node is allocated
+//per push, fine for the rate of player input
+template<typename T>
+class CommandQueue {
+    struct Node {
+        T value;
+        Node* next;
+    };
+
+    std::atomic<Node*> head_{nullptr}; //newest
+
+public:
+    CommandQueue() = default;
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    ~CommandQueue() {
+        drain([](T&) {});
+    }
+
+    //any thread
+    void push(T value) {
+        Node* node = new Node{std::move(value), head_.load(std::memory_order_relaxed)};
+        while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    //consumer thread only: fn(value) for everything pushed so far, in push order
+    template<typename F>
+    int drain(F fn) {
+        Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+        Node* oldest = nullptr;
+        while (node) {
+            Node* next = node->next;
+            node->next = oldest;
+            oldest = node;
+            node = next;
+        }
+        int count = 0;
+        while (oldest) {
+            Node* next = oldest->next;
+            fn(oldest->value);
+            delete oldest;
+            oldest = next;
+            ++count;
+        }
+        return count;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == nullptr;
+    }
+};
+
+//what the player asked for. commands are plain values applied at the start of a tick,
+//so a recorded list of them with their ticks replays a session
+enum class CommandType {
+    SELECT_AREA,
+    UNSELECT_ALL,
+    MARK_TREES, //the selected ones
+    UNMARK_TREES,
+    MAKE_STORAGE,
+    SET_DOOR,
+    SET_WALL
+};
+
+struct PlayerCommand {
+    CommandType type;
+    Location start; //the tile, or a corner of the area
+    Location end; //the other corner
+};
+
+//sent back to the UI once a command was applied
+struct CommandResult {
+    CommandType type;
+    bool ok;
+};
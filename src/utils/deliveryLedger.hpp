@@ -0,0 +1,135 @@
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../components/component.hpp"
+#include "stockpile.hpp"
+
+//construction material bookkeeping: what blueprints still need, what storages can still give,
+//and the deliveries in between. a delivery reserves its wood at the storage tile (in the
+//stockpile manager) until it is picked up, and counts as inbound at the blueprint until it is closed.
+//blueprints nobody can supply are parked, and woken only when new supply shows up
+class DeliveryLedger {
+public:
+    struct Job {
+        int id;
+        Entity blueprint;
+        Entity storage; //-1 if the wood is already in the actor's bag
+        Entity actor;
+        int amount;
+        bool picked; //wood has left the storage
+    };
+
+private:
+    StockpileManager& stockpiles_;
+    std::unordered_map<int, Job> jobs_;
+    std::unordered_map<Entity, int> by_actor_; //actor -> job id
+    std::unordered_map<Entity, int> inbound_; //blueprint -> wood on its way
+    std::unordered_set<Entity> parked_;
+    bool supply_added_ = false;
+    int next_id_ = 0;
+
+    static void add(std::unordered_map<Entity, int>& counts, Entity entity, int amount) {
+        if ((counts[entity] += amount) <= 0)
+            counts.erase(entity);
+    }
+
+    static int get(const std::unordered_map<Entity, int>& counts, Entity entity) {
+        auto it = counts.find(entity);
+        return it == counts.end() ? 0 : it->second;
+    }
+
+public:
+    DeliveryLedger(StockpileManager& stockpiles) : stockpiles_(stockpiles) {}
+
+    int reserve(Entity blueprint, Entity storage, Entity actor, int amount) {
+        close(job_of(actor));
+        int id = ++next_id_;
+        jobs_[id] = Job{id, blueprint, storage, actor, amount, storage == -1};
+        by_actor_[actor] = id;
+        add(inbound_, blueprint, amount);
+        if (storage != -1)
+            stockpiles_.reserve(storage, amount);
+        parked_.erase(blueprint);
+        return id;
+    }
+
+    //wood left the storage, the storage's own count already dropped
+    void picked(int id) {
+        auto it = jobs_.find(id);
+        if (it == jobs_.end() || it->second.picked)
+            return;
+        it->second.picked = true;
+        stockpiles_.reserve(it->second.storage, -it->second.amount);
+    }
+
+    //delivered or given up. reserved wood that was never picked is supply again
+    void close(int id) {
+        auto it = jobs_.find(id);
+        if (it == jobs_.end())
+            return;
+        auto& job = it->second;
+        add(inbound_, job.blueprint, -job.amount);
+        if (!job.picked) {
+            stockpiles_.reserve(job.storage, -job.amount);
+            supply_added_ = true;
+        }
+        by_actor_.erase(job.actor);
+        jobs_.erase(it);
+    }
+
+    int job_of(Entity actor) const {
+        auto it = by_actor_.find(actor);
+        return it == by_actor_.end() ? -1 : it->second;
+    }
+
+    const Job* find(int id) const {
+        auto it = jobs_.find(id);
+        return it == jobs_.end() ? nullptr : &it->second;
+    }
+
+    std::vector<int> job_ids() const {
+        std::vector<int> ids;
+        for (auto& pair : jobs_)
+            ids.push_back(pair.first);
+        return ids;
+    }
+
+    int inbound(Entity blueprint) const {
+        return get(inbound_, blueprint);
+    }
+
+    //nothing to deliver from, no task until supply_added wakes it
+    void park(Entity blueprint) {
+        parked_.insert(blueprint);
+    }
+
+    bool is_parked(Entity blueprint) const {
+        return parked_.count(blueprint) != 0;
+    }
+
+    //wood was stored or picked up somewhere
+    void supply_added() {
+        supply_added_ = true;
+    }
+
+    //parked blueprints, if any supply showed up since the last call
+    Entities wake() {
+        Entities woken;
+        if (!supply_added_)
+            return woken;
+        supply_added_ = false;
+        woken.assign(parked_.begin(), parked_.end());
+        parked_.clear();
+        return woken;
+    }
+
+    size_t size() const {
+        return jobs_.size();
+    }
+
+    size_t parked() const {
+        return parked_.size();
+    }
+};
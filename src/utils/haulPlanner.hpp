@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <cstdlib>
+#include "../components/component.hpp"
+
+//2-opt passes over the route, each pass is O(n^2)
+#define HAUL_2OPT_PASSES 8
+
+//orders pickup stops into one route: nearest neighbour from the start, then 2-opt.
+//the start is fixed, and so is the end (drop off) if there is one.
+//distances are manhattan, planning should not cost path searches
+class HaulPlanner {
+    static int distance(const Location& a, const Location& b) {
+        return std::abs(a.x - b.x) + std::abs(a.y - b.y);
+    }
+
+public:
+    //returns indices into stops in visiting order
+    static std::vector<int> order(const Location& start, const Locations& stops, const Location* end) {
+        int n = static_cast<int>(stops.size());
+        std::vector<int> route;
+        std::vector<bool> visited(n, false);
+        Location cur = start;
+        for (int step = 0; step < n; ++step) {
+            int best = -1;
+            for (int i = 0; i < n; ++i) {
+                if (!visited[i] && (best == -1 || distance(cur, stops[i]) < distance(cur, stops[best])))
+                    best = i;
+            }
+            visited[best] = true;
+            route.push_back(best);
+            cur = stops[best];
+        }
+
+        //point k of the route: start, stops in route order, then end if any
+        auto point = [&](int k) -> const Location& {
+            if (k == 0) return start;
+            if (k <= n) return stops[route[k - 1]];
+            return *end;
+        };
+        int last = end ? n + 1 : n;
+
+        //reverse route[i..j] if it shortens the tour, edges (i-1, i) and (j, j+1)
+        for (int pass = 0; pass < HAUL_2OPT_PASSES; ++pass) {
+            bool improved = false;
+            for (int i = 1; i <= n; ++i) {
+                for (int j = i + 1; j <= n; ++j) {
+                    int before = distance(point(i - 1), point(i));
+                    int after = distance(point(i - 1), point(j));
+                    if (j < last) {
+                        before += distance(point(j), point(j + 1));
+                        after += distance(point(i), point(j + 1));
+                    }
+                    if (after < before) {
+                        std::reverse(route.begin() + i - 1, route.begin() + j);
+                        improved = true;
+                    }
+                }
+            }
+            if (!improved)
+                break;
+        }
+        return route;
+    }
+
+    static int length(const Location& start, const Locations& stops, const std::vector<int>& route, const Location* end) {
+        int total = 0;
+        Location cur = start;
+        for (auto i : route) {
+            total += distance(cur, stops[i]);
+            cur = stops[i];
+        }
+        if (end)
+            total += distance(cur, *end);
+        return total;
+    }
+};
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <algorithm>
+#if defined(_WIN32)
+//windows.h defines near and far as macros, keep them out of identifiers in headers that include this
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+//parallel_for aims at this many chunks per thread, so a slow chunk can be balanced by stealing
+#define JOB_CHUNKS_PER_THREAD 4
+
+//work-stealing job system. every worker has its own deque: it pushes and pops at the back,
+//idle workers steal from the front of the others. queue 0 has no worker of its own: any
+//non-worker thread that submits or waits uses queue 0 and helps run jobs while it waits,
+//whichever thread created the system. a Counter counts unfinished jobs; wait() on it,
+//or give it jobs that only start once it is done. with 1 thread everything runs inline,
+//in submission order, for deterministic debugging
+class JobSystem {
+public:
+    class Counter {
+        friend class JobSystem;
+        std::atomic<int> pending_{0};
+        std::mutex mutex_;
+        std::vector<std::function<void()>> continuations_;
+    public:
+        //takes the mutex, so once this is true no finishing job touches the counter any more
+        //and it may be destroyed
+        bool done() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return pending_.load(std::memory_order_acquire) == 0;
+        }
+    };
+
+private:
+    struct Job {
+        std::function<void()> run;
+        Counter* counter;
+    };
+
+    struct Queue {
+        std::deque<Job> jobs;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_; //one per worker, 0 is for any non-worker thread
+    std::vector<std::thread> threads_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<int> queued_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+
+    static inline int default_threads_ = 0;
+    static inline thread_local const JobSystem* owner_ = nullptr;
+    static inline thread_local int index_ = 0;
+
+    int current_queue() const {
+        return owner_ == this ? index_ : 0;
+    }
+
+    void push(Job job) {
+        auto& queue = *queues_[current_queue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        queued_.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+        }
+        wake_.notify_one();
+    }
+
+    //own jobs newest first, then the oldest job of another thread
+    bool take(Job& job) {
+        int self = current_queue();
+        int count = static_cast<int>(queues_.size());
+        for (int i = 0; i < count; ++i) {
+            auto& queue = *queues_[(self + i) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+            if (i == 0) {
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+            } else {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+            }
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void finish(Counter* counter) {
+        if (!counter)
+            return;
+        std::vector<std::function<void()>> continuations;
+        {
+            std::lock_guard<std::mutex> lock(counter->mutex_);
+            if (counter->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                continuations.swap(counter->continuations_);
+        }
+        for (auto& continuation : continuations)
+            continuation();
+    }
+
+    bool run_one() {
+        Job job;
+        if (!take(job))
+            return false;
+        job.run();
+        finish(job.counter);
+        return true;
+    }
+
+    void work(int index) {
+        owner_ = this;
+        index_ = index;
+        set_thread_name("job worker " + std::to_string(index));
+        while (!stopping_) {
+            if (run_one())
+                continue;
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this] { return stopping_ || queued_.load(std::memory_order_acquire) > 0; });
+        }
+    }
+
+public:
+    //thread count for systems created without one, e.g. from the command line. 0 is one per core
+    static void set_default_threads(int threads) {
+        default_threads_ = threads;
+    }
+
+    static int default_threads() {
+        if (default_threads_ > 0)
+            return default_threads_;
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    //names the calling thread, for debuggers and profilers
+    static void set_thread_name(const std::string& name) {
+#if defined(_WIN32)
+        //SetThreadDescription is missing before Windows 10 1607, so look it up
+        using SetDescription = HRESULT (WINAPI*)(HANDLE, PCWSTR);
+        auto set = reinterpret_cast<SetDescription>(
+            GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription"));
+        if (set) {
+            std::wstring wide(name.begin(), name.end());
+            set(GetCurrentThread(), wide.c_str());
+        }
+#elif defined(__linux__)
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#elif defined(__APPLE__)
+        pthread_setname_np(name.c_str());
+#endif
+    }
+
+    JobSystem(int threads = default_threads()) {
+        threads = std::max(threads, 1);
+        owner_ = this;
+        index_ = 0;
+        for (int i = 0; i < threads; ++i)
+            queues_.push_back(std::make_unique<Queue>());
+        for (int i = 1; i < threads; ++i)
+            threads_.emplace_back(&JobSystem::work, this, i);
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_)
+            thread.join();
+        if (owner_ == this)
+            owner_ = nullptr;
+    }
+
+    int size() const {
+        return static_cast<int>(queues_.size());
+    }
+
+    void run(std::function<void()> job, Counter& counter) {
+        counter.pending_.fetch_add(1, std::memory_order_relaxed);
+        if (size() == 1) {
+            job();
+            finish(&counter);
+            return;
+        }
+        push(Job{std::move(job), &counter});
+    }
+
+    //job starts once dependency is done
+    void run_after(Counter& dependency, std::function<void()> job, Counter& counter) {
+        counter.pending_.fetch_add(1, std::memory_order_relaxed);
+        auto start = [this, job = std::move(job), &counter]() mutable {
+            if (size() == 1) {
+                job();
+                finish(&counter);
+            } else {
+                push(Job{std::move(job), &counter});
+            }
+        };
+        {
+            std::lock_guard<std::mutex> lock(dependency.mutex_);
+            if (dependency.pending_.load(std::memory_order_acquire) != 0) {
+                dependency.continuations_.push_back(std::move(start));
+                return;
+            }
+        }
+        start();
+    }
+
+    //runs jobs (its own or stolen) until counter is done
+    void wait(Counter& counter) {
+        while (!counter.done())
+            if (!run_one())
+                std::this_thread::yield();
+    }
+
+    //fn(first, last) over [begin, end) in chunks of about grain, sized automatically if grain <= 0
+    template<typename F>
+    void parallel_for(int begin, int end, F fn, int grain = 0) {
+        int count = end - begin;
+        if (count <= 0)
+            return;
+        if (size() == 1) {
+            fn(begin, end);
+            return;
+        }
+        if (grain <= 0)
+            grain = std::max(1, count / (size() * JOB_CHUNKS_PER_THREAD));
+        Counter counter;
+        for (int first = begin; first < end; first += grain) {
+            int last = std::min(first + grain, end);
+            run([&fn, first, last] { fn(first, last); }, counter);
+        }
+        wait(counter);
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <memory>
+#include <limits.h>
+#include "../components/component.hpp"
+
+#define LANDMARK_COUNT 4
+#define LANDMARK_UNREACHABLE INT_MAX
+
+//distance tables from a few landmarks, used for ALT (A*, landmarks, triangle inequality) heuristics
+//from_[i][cell] is the travel cost landmark i -> cell, to_[i][cell] is cell -> landmark i
+//costs are directed (cost of leaving a tile), so both directions are stored
+class LandmarkTable {
+    int map_size_;
+    std::vector<Location> landmarks_;
+    std::vector<std::vector<int>> from_;
+    std::vector<std::vector<int>> to_;
+
+    int index(const Location& loc) const { return loc.x * map_size_ + loc.y; }
+
+    //reverse = false: cost from source to every cell, edge u->v costs cost[u]
+    //reverse = true: cost from every cell to source
+    std::vector<int> dijkstra(const Location& source, const std::vector<std::vector<bool>>& blocked,
+        const std::vector<std::vector<int>>& cost, bool reverse) const {
+        std::vector<int> dist(map_size_ * map_size_, LANDMARK_UNREACHABLE);
+        std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<std::pair<int, int>>> pq;
+        dist[index(source)] = 0;
+        pq.push({0, index(source)});
+        while (!pq.empty()) {
+            auto [d, cell] = pq.top();
+            pq.pop();
+            if (d > dist[cell])
+                continue;
+            Location cur{cell / map_size_, cell % map_size_};
+            for (const auto& direction : directions) {
+                Location next{cur.x + direction.first, cur.y + direction.second};
+                if (next.x < 0 || next.x >= map_size_ || next.y < 0 || next.y >= map_size_ || blocked[next.x][next.y])
+                    continue;
+                int nd = d + (reverse ? cost[next.x][next.y] : cost[cur.x][cur.y]);
+                if (nd < dist[index(next)]) {
+                    dist[index(next)] = nd;
+                    pq.push({nd, index(next)});
+                }
+            }
+        }
+        return dist;
+    }
+
+public:
+    LandmarkTable(int map_size) : map_size_(map_size) {}
+
+    //pick landmarks by farthest point selection and fill the tables
+    //runs on a snapshot of the grid, so it is safe to call from a background thread
+    static std::shared_ptr<const LandmarkTable> build(std::vector<std::vector<bool>> blocked,
+        std::vector<std::vector<int>> cost, int count) {
+        int map_size = static_cast<int>(blocked.size());
+        auto table = std::make_shared<LandmarkTable>(map_size);
+
+        Location seed{-1, -1};
+        for (int i = 0; i < map_size && seed.x == -1; ++i)
+            for (int j = 0; j < map_size && seed.x == -1; ++j)
+                if (!blocked[i][j]) seed = Location{i, j};
+        if (seed.x == -1)
+            return table;
+
+        //min distance of every cell to the chosen landmarks, start from the seed
+        std::vector<int> nearest = table->dijkstra(seed, blocked, cost, false);
+        for (int k = 0; k < count; ++k) {
+            int best = -1;
+            for (int cell = 0; cell < map_size * map_size; ++cell) {
+                if (nearest[cell] != LANDMARK_UNREACHABLE && (best == -1 || nearest[cell] > nearest[best]))
+                    best = cell;
+            }
+            if (best == -1 || (k > 0 && nearest[best] == 0))
+                break;
+            Location landmark{best / map_size, best % map_size};
+            table->landmarks_.push_back(landmark);
+            table->from_.push_back(table->dijkstra(landmark, blocked, cost, false));
+            table->to_.push_back(table->dijkstra(landmark, blocked, cost, true));
+            auto& from = table->from_.back();
+            for (int cell = 0; cell < map_size * map_size; ++cell)
+                nearest[cell] = std::min(nearest[cell], from[cell]);
+        }
+        return table;
+    }
+
+    //lower bound of travel cost a -> b by triangle inequality, 0 if nothing is known
+    int lower_bound(const Location& a, const Location& b) const {
+        int best = 0;
+        int ia = index(a), ib = index(b);
+        for (size_t i = 0; i < landmarks_.size(); ++i) {
+            //d(L, b) - d(L, a) <= d(a, b)
+            if (from_[i][ia] != LANDMARK_UNREACHABLE && from_[i][ib] != LANDMARK_UNREACHABLE)
+                best = std::max(best, from_[i][ib] - from_[i][ia]);
+            //d(a, L) - d(b, L) <= d(a, b)
+            if (to_[i][ia] != LANDMARK_UNREACHABLE && to_[i][ib] != LANDMARK_UNREACHABLE)
+                best = std::max(best, to_[i][ia] - to_[i][ib]);
+        }
+        return best;
+    }
+
+    const std::vector<Location>& get_landmarks() const {
+        return landmarks_;
+    }
+};
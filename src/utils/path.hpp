@@ -5,23 +5,77 @@
 #include <unordered_map>
 #include <algorithm>
 #include <limits.h>
+#include <unordered_set>
+#include <future>
+#include <memory>
+#include <chrono>
 #include "../entities/entity.hpp"
+#include "reservation.hpp"
+#include "landmark.hpp"
+#include "pathPool.hpp"
+#include "pathSearch.hpp"
+#include "targetEvents.hpp"
+#include "stockpile.hpp"
+#include "deliveryLedger.hpp"
+#include "timerWheel.hpp"
+#include "random.hpp"
+
+//rebuild landmark tables once this many tiles changed since the last build
+#define LANDMARK_REBUILD_CHANGES 8
 
 class Router {
     ComponentManager& component_manager_;
     EntityManager& entity_manager_;
     std::vector<std::vector<bool>> mark_map_;
-    std::vector<std::vector<bool>> slow_map_;
+    std::vector<std::vector<int>> cost_map_; //terrain, rebuilt with collision
+    std::vector<std::vector<bool>> static_mark_; //mark_map_ without movers, what landmark tables are built on
+    std::vector<std::vector<Entities>> sleepers_; //entities put to sleep on each tile, for wake_around
+    int grid_version_ = 0; //bumped when static_mark_ or cost_map_ changed, movers don't count
+    bool collision_dirty_ = true; //mark_map_ and cost_map_ are rebuilt on the next update_collision
+    ReservationTable reservations_;
+    PathPool paths_;
+    TargetEvents target_events_;
+    StockpileManager stockpiles_;
+    DeliveryLedger delivery_ledger_;
+    TimerWheel timers_;
+    RandomSource random_;
     int MAP_SIZE_;
+
+    //landmark tables are built in background on a snapshot of the grid. a table stays a lower
+    //bound while tiles only get blocked or dearer, so it is dropped as soon as one opens up or
+    //gets cheaper, and searches use manhattan until the rebuild is in
+    std::shared_ptr<const LandmarkTable> landmarks_;
+    std::vector<std::vector<bool>> table_mark_; //grid landmarks_ was built on
+    std::vector<std::vector<int>> table_cost_;
+    std::future<std::shared_ptr<const LandmarkTable>> landmark_job_;
+    std::vector<std::vector<bool>> landmark_mark_; //grid the pending build runs on
+    std::vector<std::vector<int>> landmark_cost_;
+
+    struct SearchStats {
+        long long searches = 0;
+        long long expanded = 0;
+        long long expanded_manhattan = 0; //same searches with manhattan only, if compare is on
+    } search_stats_;
+    //run every search a second time with manhattan only, to see what the landmarks save.
+    //doubles the cost of A*, so it is off unless asked for
+    static inline bool compare_heuristics_ = false;
 public:
     Router();
+
+    static void set_compare_heuristics(bool compare) {
+        compare_heuristics_ = compare;
+    }
     
     Router(ComponentManager& component_manager, EntityManager& entity_manager, int map_size) :
         component_manager_(component_manager),
         entity_manager_(entity_manager),
+        stockpiles_(component_manager),
+        delivery_ledger_(stockpiles_),
         MAP_SIZE_(map_size) {
             mark_map_.resize(MAP_SIZE_, std::vector<bool>(MAP_SIZE_, false));
-            slow_map_.resize(MAP_SIZE_, std::vector<bool>(MAP_SIZE_, false));
+            static_mark_.resize(MAP_SIZE_, std::vector<bool>(MAP_SIZE_, false));
+            cost_map_.resize(MAP_SIZE_, std::vector<int>(MAP_SIZE_, TILE_COST));
+            sleepers_.resize(MAP_SIZE_, std::vector<Entities>(MAP_SIZE_));
             std::cout << "Router initialized" << std::endl;
         }
 
@@ -41,11 +95,23 @@ public:
         return pos.x >= minX && pos.x <= maxX && pos.y >= minY && pos.y <= maxY;
     }
     
+    //something collidable appeared, went away, moved or was built. the maps are rebuilt lazily,
+    //once, by the next update_collision instead of by every query
+    void invalidate_collision() {
+        collision_dirty_ = true;
+    }
+
     void update_collision() {
+        if (!collision_dirty_)
+            return;
+        collision_dirty_ = false;
+        auto old_mark = static_mark_;
+        auto old_cost = cost_map_;
         for(int i = 0; i < MAP_SIZE_; ++i) {
             for(int j = 0; j < MAP_SIZE_; ++j) {
                 mark_map_[i][j] = false;
-                slow_map_[i][j] = false;
+                static_mark_[i][j] = false;
+                cost_map_[i][j] = TILE_COST;
             }
         }
 
@@ -60,16 +126,48 @@ public:
             auto loc = component_manager_.get_component<LocationComponent>(entity).loc;
             auto collision = component_manager_.get_component<RenderComponent>(entity).collidable;
             mark_map_[loc.x][loc.y] = collision;
+            //a mover only makes paths longer while it is there, leave it out of the tables
+            if (collision && !component_manager_.has_component<MovementComponent>(entity))
+                static_mark_[loc.x][loc.y] = true;
 
             auto& render = component_manager_.get_component<RenderComponent>(entity);
             if (render.entityType == EntityType::DOOR) {
                 assert(component_manager_.has_component<ConstructionComponent>(entity));
                 auto construction = component_manager_.get_component<ConstructionComponent>(entity);
-                slow_map_[loc.x][loc.y] = construction.is_built;
+                cost_map_[loc.x][loc.y] = construction.is_built ? DOOR_COST : TILE_COST;
             }
+            //never below TILE_COST, so manhattan distance stays an admissible heuristic
+            assert(cost_map_[loc.x][loc.y] >= TILE_COST);
+        }
+        //tables may only assume tiles blocked that searches find blocked too
+        for (int i = 0; i < MAP_SIZE_; ++i)
+            for (int j = 0; j < MAP_SIZE_; ++j)
+                static_mark_[i][j] = static_mark_[i][j] && mark_map_[i][j];
+        if (static_mark_ != old_mark || cost_map_ != old_cost)
+            ++grid_version_;
+
+        if (landmarks_ && is_cheaper_than(table_mark_, table_cost_)) {
+            std::cout << "grid opened up, landmark tables dropped until rebuilt" << std::endl;
+            landmarks_ = nullptr;
         }
     }
 
+    //some tile is free now that was blocked in the given grid, or costs less than there.
+    //distances can only have shrunk, so tables built on that grid may overestimate
+    bool is_cheaper_than(const std::vector<std::vector<bool>>& mark, const std::vector<std::vector<int>>& cost) {
+        for (int i = 0; i < MAP_SIZE_; ++i) {
+            for (int j = 0; j < MAP_SIZE_; ++j) {
+                if ((mark[i][j] && !static_mark_[i][j]) || cost_map_[i][j] < cost[i][j])
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    bool is_in_map(const Location& pos) const {
+        return pos.x >= 0 && pos.x < MAP_SIZE_ && pos.y >= 0 && pos.y < MAP_SIZE_;
+    }
+
     bool is_valid_position(const Location& pos) {
         if (pos.x < 0 || pos.x >= MAP_SIZE_ || pos.y < 0 || pos.y >= MAP_SIZE_)
             return false;
@@ -77,9 +175,19 @@ public:
         return !mark_map_[pos.x][pos.y];
     }
 
-    bool to_be_slow(const Location loc) {
-        return slow_map_[loc.x][loc.y];
-    } 
+    //same as is_valid_position, but uses collision map built by last update_collision
+    //searches refresh the map once and then call this for every neighbour.
+    //safe to call from several threads while nobody updates the map
+    bool is_passable(const Location& pos) {
+        if (pos.x < 0 || pos.x >= MAP_SIZE_ || pos.y < 0 || pos.y >= MAP_SIZE_)
+            return false;
+        return !mark_map_[pos.x][pos.y];
+    }
+
+    //cost of leaving this tile, it slows movement down and path searches pay it
+    int get_terrain_cost(const Location& loc) {
+        return cost_map_[loc.x][loc.y];
+    }
 
     Locations get_locations_around(const Location& pos) {
         Locations locations;
@@ -117,41 +225,52 @@ public:
     }
 
     Path find_path_to_locations(const Location& start, const Locations& end_locations, std::string method) {
+        if (method != "BFS")
+            return find_path_Ax(start, end_locations);
         for (int i = 0; i < end_locations.size(); ++i) {
-            auto path = method == "BFS" ? find_path_BFS(start, end_locations[i]) : find_path_Ax(start, end_locations[i]);
+            auto path = find_path_BFS(start, end_locations[i]);
             if (path.size() > 0)
                 return path;
         }
         return {};
     }
 
+    //breadth first in travel cost (uniform cost search), so tile costs are respected
+    //path does not include start
     Path find_path_BFS(const Location& start, const Location& end) {
         //std::cout << "try to find path from (" << start.x << ", " << start.y << ") to (" << end.x << ", " << end.y << ")" << std::endl;
         if (start == end) return {};
 
-        std::queue<Location> queue;
+        std::priority_queue<std::pair<int, Location>, std::vector<std::pair<int, Location>>, CompareLocation> queue;
+        std::unordered_map<Location, int, std::hash<Location>> cost_so_far;
         std::unordered_map<Location, Location, std::hash<Location>> came_from;
-        queue.push(start);
+        queue.push({0, start});
+        cost_so_far[start] = 0;
+        update_collision();
 
         while (!queue.empty()) {
-            Location current = queue.front();
+            auto [cost, current] = queue.top();
             queue.pop();
+            if (cost > cost_so_far[current])
+                continue;
+
+            if (current == end) {
+                Path path;
+                for (Location step = end; step != start; step = came_from[step]) {
+                    path.push_back(Location{step.x, step.y});
+                }
+                std::reverse(path.begin(), path.end());
+                return path;
+            }
 
             for (const auto& direction : directions) {
                 Location next = {current.x + direction.first, current.y + direction.second};
+                int new_cost = cost + get_terrain_cost(current);
 
-                if (is_valid_position(next) && came_from.find(next) == came_from.end()) {
-                    queue.push(next);
+                if (is_passable(next) && (cost_so_far.find(next) == cost_so_far.end() || new_cost < cost_so_far[next])) {
+                    cost_so_far[next] = new_cost;
                     came_from[next] = current;
-
-                    if (next == end) {
-                        Path path;
-                        for (Location step = end; step != start; step = came_from[step]) {
-                            path.push_back(Location{step.x, step.y});
-                        }
-                        std::reverse(path.begin(), path.end());
-                        return path;
-                    }
+                    queue.push({new_cost, next});
                 }
             }
         }
@@ -164,54 +283,211 @@ public:
         }
     };
 
-    int heuristic(const Location& a, const Location& b) { return abs(a.x - b.x) + abs(a.y - b.y); }
+    //every step costs at least TILE_COST, so this never overestimates
+    int heuristic(const Location& a, const Location& b) { return (abs(a.x - b.x) + abs(a.y - b.y)) * TILE_COST; }
 
     Path find_path_Ax(const Location& start, const Location& end) {
-        if (start == end) return {};
+        return find_path_Ax(start, Locations{end});
+    }
 
-        std::priority_queue<std::pair<int, Location>, std::vector<std::pair<int, Location>>, CompareLocation> pq;
-        pq.push({0, start});
+    //one search towards all end locations, returns the cheapest one to reach
+    //path does not include start, a repeated start would read as a wait in the path pool
+    Path find_path_Ax(const Location& start, const Locations& end_locations) {
+        if (end_locations.empty() || is_in_locations(start, end_locations)) return {};
+        update_collision();
 
-        std::unordered_map<Location, int, std::hash<Location>> cost_so_far;
-        cost_so_far[start] = 0;
+        PathSearch search(get_search_grid(), start, end_locations, landmarks_);
+        search.run(INT_MAX);
+        ++search_stats_.searches;
+        search_stats_.expanded += search.expanded();
+        if (compare_heuristics_) {
+            PathSearch manhattan(get_search_grid(), start, end_locations, nullptr);
+            manhattan.run(INT_MAX);
+            search_stats_.expanded_manhattan += manhattan.expanded();
+        }
 
-        std::unordered_map<Location, Location, std::hash<Location>> came_from;
-        came_from[start] = start;
+        if (search.status() != PathSearch::FOUND)
+            return {};
+        return search.path();
+    }
 
-        while (!pq.empty()) {
-            auto [priority, current] = pq.top();
-            pq.pop();
+    //called on a fixed period: swap in the tables started on the previous call, then start a
+    //new build in background when there is no usable table or the grid changed enough.
+    //waiting for the build here instead of taking it whenever it is done puts the swap on
+    //the same tick in every run
+    void refresh_landmarks() {
+        update_collision();
+        if (landmark_job_.valid()) {
+            auto table = landmark_job_.get();
+            if (is_cheaper_than(landmark_mark_, landmark_cost_)) {
+                std::cout << "grid opened up during landmark build, tables discarded" << std::endl;
+            } else {
+                landmarks_ = std::move(table);
+                table_mark_ = std::move(landmark_mark_);
+                table_cost_ = std::move(landmark_cost_);
+                std::cout << "landmark tables rebuilt, " << landmarks_->get_landmarks().size() << " landmarks" << std::endl;
+            }
+        }
 
-            if (current == end) {
-                Path path;
-                for (Location step = end; came_from.find(step) != came_from.end() && step != start; step = came_from[step]) {
-                    path.push_back(Location{step.x, step.y});
+        //blocked or dearer tiles keep the table a lower bound, only looser. rebuild once there are many
+        int changed = 0;
+        if (!landmarks_) {
+            changed = LANDMARK_REBUILD_CHANGES;
+        } else {
+            for (int i = 0; i < MAP_SIZE_; ++i) {
+                for (int j = 0; j < MAP_SIZE_; ++j) {
+                    if (table_mark_[i][j] != static_mark_[i][j] || table_cost_[i][j] != get_terrain_cost({i, j}))
+                        ++changed;
                 }
-                path.push_back(Location{start.x, start.y}); // 加入起始点
-                std::reverse(path.begin(), path.end());
-                return path;
             }
+        }
+        if (changed < LANDMARK_REBUILD_CHANGES)
+            return;
+
+        landmark_mark_ = static_mark_;
+        landmark_cost_ = cost_map_;
+        if (landmarks_)
+            std::cout << changed << " tiles changed, rebuild landmark tables in background" << std::endl;
+        else
+            std::cout << "no usable landmark tables, build them in background" << std::endl;
+        landmark_job_ = std::async(std::launch::async, &LandmarkTable::build, landmark_mark_, landmark_cost_, LANDMARK_COUNT);
+    }
 
-            for (const auto& direction : directions) {
-                Location next = {current.x + direction.first, current.y + direction.second};
+    long long get_search_count() const {
+        return search_stats_.searches;
+    }
 
-                int new_cost = cost_so_far[current] + 1; // 假设每个移动的代价为1
+    void print_search_stats() {
+        std::cout << "stats: " << search_stats_.searches << " A* searches, " << search_stats_.expanded << " nodes expanded";
+        if (compare_heuristics_)
+            std::cout << " (manhattan only: " << search_stats_.expanded_manhattan << ")";
+        std::cout << std::endl;
+    }
 
-                if (is_valid_position(next) && (cost_so_far.find(next) == cost_so_far.end() || new_cost < cost_so_far[next])) {
-                    cost_so_far[next] = new_cost;
-                    int priority = new_cost + heuristic(end, next);
-                    pq.push({priority, next});
-                    came_from[next] = current;
-                }
-            }
+    //windowed cooperative A*: for the first COOP_WINDOW ticks search in (tile, tick) space
+    //and skip pairs reserved by other agents, the rest of the route is plain A*.
+    //waiting costs one tick and shows up in the path as the current tile repeated
+    Path find_path_cooperative(Entity entity, const Location& start, const Locations& end_locations, int ticks_per_step) {
+        if (is_in_locations(start, end_locations)) return {};
+        update_collision();
+
+        PathSearch search(get_search_grid(), start, end_locations, landmarks_,
+            &reservations_, entity, ticks_per_step, reservations_.now());
+        if (search.run(INT_MAX) != PathSearch::FOUND) {
+            std::cout << "cooperative search failed, fall back to A*" << std::endl;
+            return find_path_to_locations(start, end_locations, "Ax");
+        }
+
+        auto path = search.path();
+        //window exhausted before reaching target, finish the route without reservations
+        if (!search.reached_goal()) {
+            auto rest = find_path_to_locations(search.last(), end_locations, "Ax");
+            if (rest.empty())
+                return {};
+            path.insert(path.end(), rest.begin(), rest.end());
         }
-        return {};   
+        return path;
+    }
+
+    //searches that span ticks compare this to notice that the grid changed under them
+    int get_grid_version() const {
+        return grid_version_;
+    }
+
+    SearchGrid get_search_grid() {
+        return SearchGrid{mark_map_, cost_map_, MAP_SIZE_};
+    }
+
+    std::shared_ptr<const LandmarkTable> get_landmarks() {
+        return landmarks_;
+    }
+
+    //reserve tiles along a path returned by find_path_cooperative, up to the window
+    void reserve_path(Entity entity, const Location& start, const Path& path, int ticks_per_step) {
+        reservations_.release(entity);
+        int t = reservations_.now();
+        int end = t + COOP_WINDOW;
+        Location prev = start;
+        for (auto& step : path) {
+            if (t >= end) break;
+            int d = step == prev ? 1 : ticks_per_step * get_terrain_cost(prev);
+            reservations_.reserve(entity, prev, t, t + d);
+            reservations_.reserve(entity, step, t, t + d);
+            prev = step;
+            t += d;
+        }
+        //hold the last reached tile for the rest of the window
+        if (t < end)
+            reservations_.reserve(entity, prev, t, end);
+    }
+
+    ReservationTable& get_reservations() {
+        return reservations_;
+    }
+
+    PathPool& get_paths() {
+        return paths_;
+    }
+
+    TargetEvents& get_target_events() {
+        return target_events_;
+    }
+
+    DeliveryLedger& get_delivery_ledger() {
+        return delivery_ledger_;
+    }
+
+    StockpileManager& get_stockpiles() {
+        return stockpiles_;
+    }
+
+    TimerWheel& get_timers() {
+        return timers_;
+    }
+
+    RandomSource& get_random() {
+        return random_;
     }
     
     Entities get_all_entities() {
         return entity_manager_.get_all_entities();
     }
 
+    Entities get_awake_entities() {
+        return entity_manager_.get_awake_entities();
+    }
+
+    //sleeping entities do not move, so they are filed under their tile for wake_around
+    void sleep(Entity entity) {
+        entity_manager_.sleep(entity);
+        if (!component_manager_.has_component<LocationComponent>(entity))
+            return;
+        auto& loc = component_manager_.get_component<LocationComponent>(entity).loc;
+        if (!is_in_map(loc))
+            return;
+        auto& tile = sleepers_[loc.x][loc.y];
+        if (std::find(tile.begin(), tile.end(), entity) == tile.end())
+            tile.push_back(entity);
+    }
+
+    //something changed at pos, sleepers on it and next to it may have something to do again.
+    //entries of entities that woke up, died or were reused meanwhile are dropped here
+    void wake_around(const Location& pos) {
+        for (int x = pos.x - 1; x <= pos.x + 1; ++x) {
+            for (int y = pos.y - 1; y <= pos.y + 1; ++y) {
+                if (!is_in_map({x, y}))
+                    continue;
+                for (auto entity : sleepers_[x][y]) {
+                    if (entity_manager_.is_entity_alive(entity) && !entity_manager_.is_awake(entity)
+                        && component_manager_.has_component<LocationComponent>(entity)
+                        && component_manager_.get_component<LocationComponent>(entity).loc == Location{x, y})
+                        entity_manager_.wake(entity);
+                }
+                sleepers_[x][y].clear();
+            }
+        }
+    }
+
     template<typename... ComponentTypes>
     Entities get_entities_with_components() {
         Entities entities;
@@ -223,6 +499,18 @@ public:
         return entities;
     }
 
+    //for the per tick walks, sleeping entities have nothing to do there
+    template<typename... ComponentTypes>
+    Entities get_awake_entities_with_components() {
+        Entities entities;
+        for (auto entity : entity_manager_.get_awake_entities()) {
+            if (component_manager_.has_component<ComponentTypes...>(entity)) {
+                entities.push_back(entity);
+            }
+        }
+        return entities;
+    }
+
     Entities get_entity_at_location(const Location& pos) {
         Entities entities;
         for(auto& entity : get_all_entities()) {
@@ -235,10 +523,11 @@ public:
         return entities;
     }
 
+    //characters and animals never sleep
     Entities get_characters() {
         Entities characters;
         //std::cout << "try: get characters" << std::endl;
-        for(auto& entity : entity_manager_.get_all_entities()) {
+        for(auto& entity : entity_manager_.get_awake_entities()) {
             //std::cout << "entity: " << entity << std::endl;
             if (component_manager_.has_component<RenderComponent>(entity) && component_manager_.get_component<RenderComponent>(entity).entityType == EntityType::CHARACTER) {
                 //std::cout << "character found" << std::endl;
@@ -251,7 +540,7 @@ public:
     Entities get_animals() {
         Entities animals;
         //std::cout << "try: get animals" << std::endl;
-        for(auto& entity : get_all_entities()) {
+        for(auto& entity : entity_manager_.get_awake_entities()) {
             //std::cout << "entity: " << entity << std::endl;
             if (component_manager_.has_component<RenderComponent>(entity) && component_manager_.get_component<RenderComponent>(entity).entityType == EntityType::DOG) {
                 //std::cout << "animal found" << std::endl;
@@ -346,12 +635,5 @@ public:
     int get_map_size() {
         return MAP_SIZE_;
     }
-};
-
-
-
-
-
-
-
 
+};
\ No newline at end of file
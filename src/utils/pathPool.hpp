@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <iostream>
+#include "../components/component.hpp"
+
+#define PATH_POOL_CHUNK 64
+#define PATH_MAX_WAYPOINTS 32
+//a truncated path asks for the rest of the route this many tiles before its end
+#define PATH_REPLAN_TILES 4
+
+//paths stored as straight-line waypoints in pooled, fixed-capacity slots
+//a mover only keeps a PathHandle, tiles are expanded one at a time as it advances
+//a waypoint equal to the tile before it is a wait of one tick
+class PathPool {
+    struct Slot {
+        std::array<Location, PATH_MAX_WAYPOINTS> waypoints;
+        int count = 0;
+        int cursor = 0; //waypoint currently heading to
+        Location at; //last tile handed out by pop_front
+        bool truncated = false; //route longer than a slot holds, mover replans at the end
+        bool in_use = false;
+        int next_free = -1;
+    };
+
+    std::vector<Slot> slots_;
+    int free_head_ = -1;
+    int in_use_ = 0;
+
+    static int sign(int v) { return (v > 0) - (v < 0); }
+
+    void grow() {
+        int first = static_cast<int>(slots_.size());
+        slots_.resize(slots_.size() + PATH_POOL_CHUNK);
+        for (int i = static_cast<int>(slots_.size()) - 1; i >= first; --i) {
+            slots_[i].next_free = free_head_;
+            free_head_ = i;
+        }
+    }
+
+    const Slot& slot(PathHandle handle) const {
+        assert(handle >= 0 && handle < static_cast<int>(slots_.size()) && slots_[handle].in_use && "Invalid path handle.");
+        return slots_[handle];
+    }
+
+    Slot& slot(PathHandle handle) {
+        assert(handle >= 0 && handle < static_cast<int>(slots_.size()) && slots_[handle].in_use && "Invalid path handle.");
+        return slots_[handle];
+    }
+
+public:
+    //compress a per-tile path starting next to start, NO_PATH if the path is empty
+    PathHandle acquire(const Location& start, const Path& path) {
+        if (path.empty())
+            return NO_PATH;
+        if (free_head_ == -1)
+            grow();
+        PathHandle handle = free_head_;
+        auto& s = slots_[handle];
+        free_head_ = s.next_free;
+        s.in_use = true;
+        s.count = 0;
+        s.cursor = 0;
+        s.at = start;
+        s.truncated = false;
+        ++in_use_;
+
+        Location prev = start;
+        Dir last_dir{0, 0};
+        for (auto& step : path) {
+            Dir dir{sign(step.x - prev.x), sign(step.y - prev.y)};
+            bool wait = step == prev;
+            if (!wait && s.count > 0 && dir == last_dir && s.waypoints[s.count - 1] == prev) {
+                //same straight line, move the last waypoint forward
+                s.waypoints[s.count - 1] = step;
+            } else if (s.count == PATH_MAX_WAYPOINTS) {
+                s.truncated = true;
+                break;
+            } else {
+                s.waypoints[s.count++] = step;
+            }
+            last_dir = wait ? Dir{0, 0} : dir;
+            prev = step;
+        }
+        return handle;
+    }
+
+    void release(PathHandle& handle) {
+        if (handle == NO_PATH)
+            return;
+        auto& s = slot(handle);
+        s.in_use = false;
+        s.next_free = free_head_;
+        free_head_ = handle;
+        --in_use_;
+        handle = NO_PATH;
+    }
+
+    bool empty(PathHandle handle) const {
+        return handle == NO_PATH || slot(handle).cursor >= slot(handle).count;
+    }
+
+    //next tile without consuming it
+    Location front(PathHandle handle) const {
+        auto& s = slot(handle);
+        assert(s.cursor < s.count && "front() on empty path.");
+        auto& target = s.waypoints[s.cursor];
+        if (target == s.at)
+            return s.at;
+        return Location{s.at.x + sign(target.x - s.at.x), s.at.y + sign(target.y - s.at.y)};
+    }
+
+    void pop_front(PathHandle handle) {
+        auto& s = slot(handle);
+        s.at = front(handle);
+        if (s.at == s.waypoints[s.cursor])
+            ++s.cursor;
+    }
+
+    //remaining tiles, walks the waypoints so it is not free
+    int size(PathHandle handle) const {
+        if (handle == NO_PATH)
+            return 0;
+        auto& s = slot(handle);
+        int tiles = 0;
+        Location prev = s.at;
+        for (int i = s.cursor; i < s.count; ++i) {
+            auto& wp = s.waypoints[i];
+            tiles += wp == prev ? 1 : std::abs(wp.x - prev.x) + std::abs(wp.y - prev.y);
+            prev = wp;
+        }
+        return tiles;
+    }
+
+    bool is_truncated(PathHandle handle) const {
+        return handle != NO_PATH && slot(handle).truncated;
+    }
+
+    int in_use() const { return in_use_; }
+    size_t capacity() const { return slots_.size(); }
+};
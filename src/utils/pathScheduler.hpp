@@ -0,0 +1,212 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include "path.hpp"
+
+//per tick budget for all queued searches together. counted in nodes, not time,
+//so how far a search gets on a tick is the same on every machine and run
+#define PATH_BUDGET_NODES 4000
+//a request gets this many expansions before the next one in line is served
+#define PATH_SLICE_NODES 256
+//recent wait times kept for percentiles
+#define PATH_WAIT_SAMPLES 512
+
+//movers submit path requests here instead of searching in place.
+//each tick the queued searches run round robin in small slices until the node budget
+//is used up, unfinished searches are suspended and resumed next tick,
+//so a burst of new tasks spreads over several ticks instead of spiking one frame.
+//a suspended search whose grid changed meanwhile starts over on the new one
+class PathScheduler {
+    struct Request {
+        int id;
+        Location start;
+        Locations goals;
+        int ticks_per_step;
+        int submitted; //tick of submission
+        int grid_version; //router grid the searches were started on
+        std::unique_ptr<PathSearch> window; //cooperative part
+        std::unique_ptr<PathSearch> tail; //plain A* after the window, or from start if window failed
+        Path result;
+        bool done = false;
+    };
+
+    Router& router_;
+    std::unordered_map<Entity, Request> requests_;
+    std::deque<std::pair<Entity, int>> queue_; //round robin order, (entity, request id)
+    int next_id_ = 0;
+    int budget_nodes_ = PATH_BUDGET_NODES;
+
+    struct Stats {
+        long long served = 0;
+        long long restarted = 0;
+        long long nodes = 0;
+        int max_depth = 0;
+        int max_tick_nodes = 0;
+    } stats_;
+    std::vector<int> waits_;
+    size_t wait_next_ = 0;
+
+    int now() const { return router_.get_reservations().now(); }
+
+    //(re)start the searches of a request from its start on the current grid
+    void restart(Entity entity, Request& request) {
+        request.grid_version = router_.get_grid_version();
+        request.window = std::make_unique<PathSearch>(router_.get_search_grid(), request.start, request.goals, router_.get_landmarks(),
+            &router_.get_reservations(), entity, request.ticks_per_step, now());
+        request.tail.reset();
+        request.result.clear();
+        request.done = false;
+    }
+
+    //run one slice, returns expansions used, sets request.done when a path (or none) is known
+    int step(Request& request, int slice) {
+        int used = 0;
+        while (!request.done && used < slice) {
+            auto& window = *request.window;
+            if (window.status() == PathSearch::RUNNING) {
+                int before = window.expanded();
+                window.run(slice - used);
+                used += window.expanded() - before;
+                continue;
+            }
+
+            if (!request.tail) {
+                if (window.status() == PathSearch::FOUND && window.reached_goal()) {
+                    request.result = window.path();
+                    request.done = true;
+                    break;
+                }
+                //window failed: plain A* from start, window ended early: finish from its last tile
+                Location from = window.status() == PathSearch::FOUND ? window.last() : request.start;
+                request.tail = std::make_unique<PathSearch>(router_.get_search_grid(), from, request.goals, router_.get_landmarks());
+            }
+
+            auto& tail = *request.tail;
+            if (tail.status() == PathSearch::RUNNING) {
+                int before = tail.expanded();
+                tail.run(slice - used);
+                used += tail.expanded() - before;
+                continue;
+            }
+
+            if (tail.status() == PathSearch::FOUND) {
+                if (window.status() == PathSearch::FOUND)
+                    request.result = window.path();
+                auto rest = tail.path();
+                request.result.insert(request.result.end(), rest.begin(), rest.end());
+            }
+            request.done = true;
+        }
+        return used;
+    }
+
+    void record_wait(int ticks) {
+        if (waits_.size() < PATH_WAIT_SAMPLES) {
+            waits_.push_back(ticks);
+        } else {
+            waits_[wait_next_] = ticks;
+            wait_next_ = (wait_next_ + 1) % PATH_WAIT_SAMPLES;
+        }
+    }
+
+    static int percentile(const std::vector<int>& sorted, int p) {
+        if (sorted.empty())
+            return 0;
+        size_t index = (sorted.size() - 1) * p / 100;
+        return sorted[index];
+    }
+
+public:
+    PathScheduler(Router& router) : router_(router) {
+        std::cout << "PathScheduler initialized" << std::endl;
+    }
+
+    //replaces a pending request of the same entity
+    void submit(Entity entity, const Location& start, const Locations& goals, int ticks_per_step) {
+        auto& request = requests_[entity];
+        request.id = next_id_++;
+        request.start = start;
+        request.goals = goals;
+        request.ticks_per_step = ticks_per_step;
+        request.submitted = now();
+        restart(entity, request);
+        queue_.emplace_back(entity, request.id);
+        stats_.max_depth = std::max(stats_.max_depth, static_cast<int>(queue_.size()));
+    }
+
+    bool is_pending(Entity entity) const {
+        return requests_.find(entity) != requests_.end();
+    }
+
+    //true and path filled (tiles after start) once the request for exactly this start and goals is finished
+    //a finished request for another start or goals is dropped
+    bool poll(Entity entity, const Location& start, const Locations& goals, Path& path) {
+        auto it = requests_.find(entity);
+        if (it == requests_.end() || !it->second.done)
+            return false;
+        bool match = it->second.start == start && it->second.goals == goals;
+        if (match)
+            path = std::move(it->second.result);
+        requests_.erase(it);
+        return match;
+    }
+
+    void cancel(Entity entity) {
+        requests_.erase(entity);
+    }
+
+    //call once per tick
+    void update() {
+        if (queue_.empty())
+            return;
+        router_.update_collision();
+        int nodes = 0;
+        while (!queue_.empty() && nodes < budget_nodes_) {
+            auto [entity, id] = queue_.front();
+            queue_.pop_front();
+            auto it = requests_.find(entity);
+            if (it == requests_.end() || it->second.id != id || it->second.done)
+                continue; //cancelled or replaced
+
+            auto& request = it->second;
+            if (request.grid_version != router_.get_grid_version()) {
+                if (request.window->expanded() > 0)
+                    ++stats_.restarted;
+                restart(entity, request);
+            }
+            nodes += step(request, std::min(PATH_SLICE_NODES, budget_nodes_ - nodes));
+            if (request.done) {
+                ++stats_.served;
+                record_wait(now() - request.submitted);
+            } else {
+                queue_.emplace_back(entity, id);
+            }
+        }
+        stats_.nodes += nodes;
+        stats_.max_tick_nodes = std::max(stats_.max_tick_nodes, nodes);
+    }
+
+    void set_node_budget(int nodes) {
+        budget_nodes_ = std::max(1, nodes);
+    }
+
+    size_t queue_depth() const {
+        return queue_.size();
+    }
+
+    long long get_served() const {
+        return stats_.served;
+    }
+
+    void print_stats() {
+        auto sorted = waits_;
+        std::sort(sorted.begin(), sorted.end());
+        std::cout << "stats: path scheduler queue depth " << queue_.size() << " (max " << stats_.max_depth << "), "
+            << stats_.served << " served, " << stats_.restarted << " restarted, " << stats_.nodes << " nodes (max " << stats_.max_tick_nodes << " per tick), "
+            << "wait p50/p90/p99 " << percentile(sorted, 50) << "/" << percentile(sorted, 90) << "/"
+            << percentile(sorted, 99) << " ticks" << std::endl;
+    }
+};
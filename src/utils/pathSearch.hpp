@@ -0,0 +1,199 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <limits.h>
+#include <cstdlib>
+#include "../components/component.hpp"
+#include "reservation.hpp"
+#include "landmark.hpp"
+
+#define COOP_WINDOW 64
+#define COOP_MAX_EXPANSION 6000
+
+//traversal cost of leaving a tile, in units of one plain step
+//movement speed on a tile is divided by its terrain cost
+#define TILE_COST 1
+#define DOOR_COST 4
+
+//the grid a search runs on, owned by the Router
+struct SearchGrid {
+    const std::vector<std::vector<bool>>& blocked;
+    const std::vector<std::vector<int>>& cost;
+    int map_size;
+
+    bool is_passable(const Location& pos) const {
+        if (pos.x < 0 || pos.x >= map_size || pos.y < 0 || pos.y >= map_size)
+            return false;
+        return !blocked[pos.x][pos.y];
+    }
+
+    int tile_cost(const Location& pos) const {
+        return cost[pos.x][pos.y];
+    }
+};
+
+//A* that can be suspended after a number of expansions and resumed later
+//plain mode searches tiles; cooperative mode searches (tile, tick) pairs for the first
+//COOP_WINDOW ticks, skips pairs reserved by others and may wait in place for one tick
+class PathSearch {
+public:
+    enum Status { RUNNING, FOUND, FAILED };
+
+private:
+    struct Node {
+        Location loc;
+        int t; //ticks from start, 0 in plain mode
+        int g;
+        int parent;
+    };
+
+    SearchGrid grid_;
+    Location start_;
+    Locations goals_;
+    std::shared_ptr<const LandmarkTable> table_;
+    const ReservationTable* reservations_ = nullptr; //cooperative mode only
+    Entity entity_ = -1;
+    int ticks_per_step_ = 1;
+    int start_tick_ = 0;
+
+    std::vector<Node> nodes_;
+    std::unordered_map<long long, int> best_g_;
+    std::unordered_set<long long> closed_;
+    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<std::pair<int, int>>> open_;
+    Status status_ = RUNNING;
+    int found_ = -1;
+    int expanded_ = 0;
+
+    bool cooperative() const { return reservations_ != nullptr; }
+
+    bool is_goal(const Location& loc) const {
+        for (auto& goal : goals_)
+            if (goal == loc) return true;
+        return false;
+    }
+
+    long long key(const Location& loc, int t) const {
+        return static_cast<long long>(t) * grid_.map_size * grid_.map_size + loc.x * grid_.map_size + loc.y;
+    }
+
+    //lower bound to the nearest goal: manhattan, tightened by landmarks
+    int h(const Location& loc) const {
+        int best = INT_MAX;
+        for (auto& goal : goals_) {
+            int d = (std::abs(goal.x - loc.x) + std::abs(goal.y - loc.y)) * TILE_COST;
+            if (table_)
+                d = std::max(d, table_->lower_bound(loc, goal));
+            best = std::min(best, d);
+        }
+        return best * ticks_per_step_;
+    }
+
+    void push(const Location& loc, int t, int g, int parent) {
+        long long k = key(loc, t);
+        if (closed_.count(k))
+            return;
+        auto it = best_g_.find(k);
+        if (it != best_g_.end() && it->second <= g)
+            return;
+        best_g_[k] = g;
+        nodes_.push_back({loc, t, g, parent});
+        open_.push({g + h(loc), static_cast<int>(nodes_.size()) - 1});
+    }
+
+    bool is_free(const Location& loc, int from, int to) const {
+        return reservations_->is_free(loc, start_tick_ + from, start_tick_ + to, entity_);
+    }
+
+public:
+    //plain A*
+    PathSearch(const SearchGrid& grid, const Location& start, const Locations& goals,
+        std::shared_ptr<const LandmarkTable> table) :
+        grid_(grid), start_(start), goals_(goals), table_(std::move(table)) {
+        if (goals_.empty())
+            status_ = FAILED;
+        else
+            push(start_, 0, 0, -1);
+    }
+
+    //windowed cooperative A*, ticks are counted from start_tick
+    PathSearch(const SearchGrid& grid, const Location& start, const Locations& goals,
+        std::shared_ptr<const LandmarkTable> table, const ReservationTable* reservations,
+        Entity entity, int ticks_per_step, int start_tick) :
+        grid_(grid), start_(start), goals_(goals), table_(std::move(table)), reservations_(reservations),
+        entity_(entity), ticks_per_step_(ticks_per_step), start_tick_(start_tick) {
+        if (goals_.empty())
+            status_ = FAILED;
+        else
+            push(start_, 0, 0, -1);
+    }
+
+    //expand at most max_expansions nodes, then return
+    Status run(int max_expansions) {
+        int budget = max_expansions;
+        while (status_ == RUNNING && budget > 0) {
+            if (open_.empty() || (cooperative() && expanded_ >= COOP_MAX_EXPANSION)) {
+                status_ = FAILED;
+                break;
+            }
+            int index = open_.top().second;
+            open_.pop();
+            Node cur = nodes_[index];
+            if (!closed_.insert(key(cur.loc, cur.t)).second)
+                continue;
+            ++expanded_;
+            --budget;
+
+            if (is_goal(cur.loc) || (cooperative() && cur.t >= COOP_WINDOW)) {
+                found_ = index;
+                status_ = FOUND;
+                break;
+            }
+
+            //wait in place
+            if (cooperative() && is_free(cur.loc, cur.t, cur.t + 1))
+                push(cur.loc, cur.t + 1, cur.g + 1, index);
+
+            int step = ticks_per_step_ * grid_.tile_cost(cur.loc);
+            for (const auto& direction : directions) {
+                Location next = {cur.loc.x + direction.first, cur.loc.y + direction.second};
+                if (!grid_.is_passable(next))
+                    continue;
+                int arrive = cooperative() ? cur.t + step : 0;
+                //both tiles are held during the step, which also rules out swapping places
+                if (cooperative() && (!is_free(next, cur.t, arrive) || !is_free(cur.loc, cur.t, arrive)))
+                    continue;
+                push(next, arrive, cur.g + step, index);
+            }
+        }
+        return status_;
+    }
+
+    Status status() const { return status_; }
+    int expanded() const { return expanded_; }
+
+    //tiles after start, a repeated tile is a wait
+    Path path() const {
+        Path path;
+        if (status_ != FOUND)
+            return path;
+        for (int i = found_; nodes_[i].parent != -1; i = nodes_[i].parent)
+            path.push_front(nodes_[i].loc);
+        return path;
+    }
+
+    //false if a cooperative search stopped at the end of its window
+    bool reached_goal() const {
+        return status_ == FOUND && is_goal(nodes_[found_].loc);
+    }
+
+    Location last() const {
+        return status_ == FOUND ? nodes_[found_].loc : start_;
+    }
+
+    const Location& get_start() const { return start_; }
+    const Locations& get_goals() const { return goals_; }
+};
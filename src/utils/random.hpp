@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <chrono>
+
+//the systems that draw random numbers, each gets its own streams
+enum class RandomStream {
+    SPAWN, //where new entities are placed, keyed by entity type
+    WANDER, //idle steps, keyed by entity
+    COUNT
+};
+
+//one SplitMix64 sequence. it is seeded from (world seed, stream, tick, key) alone, so what an
+//entity draws on a tick doesn't depend on who drew before it or on which thread it runs
+class Random {
+    std::uint64_t state_;
+
+public:
+    static std::uint64_t mix(std::uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    Random(std::uint64_t seed, RandomStream stream, std::int64_t tick, std::int64_t key)
+        : state_(mix(mix(mix(seed + static_cast<std::uint64_t>(stream)) + static_cast<std::uint64_t>(tick))
+                     + static_cast<std::uint64_t>(key))) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = state_;
+        state_ += 0x9e3779b97f4a7c15ULL;
+        return mix(z);
+    }
+
+    //lo .. hi, both included
+    int uniform(int lo, int hi) {
+        auto range = static_cast<std::uint64_t>(hi - lo) + 1;
+        return lo + static_cast<int>(((next() >> 32) * range) >> 32);
+    }
+};
+
+//the world's seed and the tick streams are drawn for. saved with the world, so a run
+//replays the same from the same seed whatever the thread count and machine speed:
+//nothing else in a tick reads the clock. path searches are budgeted in nodes, landmark
+//tables are swapped in on their refresh tick however long the build took, and system
+//time budgets are only counted in the stats. player commands apply on the tick they
+//arrive, so a replay needs them on the same ticks
+class RandomSource {
+    std::uint64_t seed_;
+    std::int64_t tick_ = 0;
+
+    static inline std::uint64_t default_seed_ = 0;
+
+public:
+    //seed for worlds created without one, e.g. from the command line. 0 picks one from the clock
+    static void set_default_seed(std::uint64_t seed) {
+        default_seed_ = seed;
+    }
+
+    static std::uint64_t default_seed() {
+        if (default_seed_ != 0)
+            return default_seed_;
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        return Random::mix(static_cast<std::uint64_t>(std::time(nullptr)) ^ static_cast<std::uint64_t>(now));
+    }
+
+    RandomSource(std::uint64_t seed = default_seed()) : seed_(seed) {}
+
+    std::uint64_t seed() const {
+        return seed_;
+    }
+
+    void set_seed(std::uint64_t seed) {
+        seed_ = seed;
+    }
+
+    void set_tick(std::int64_t tick) {
+        tick_ = tick;
+    }
+
+    //the stream of this system and key on the current tick
+    Random stream(RandomStream stream, std::int64_t key = 0) const {
+        return Random(seed_, stream, tick_, key);
+    }
+};
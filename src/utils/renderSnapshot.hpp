@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include "../components/component.hpp"
+
+//what the UI draws of one entity, copied out of the world after a tick
+struct RenderItem {
+    Entity entity;
+    EntityType type;
+    Location loc;
+    bool selected;
+    //movement this tick and the one before, progress < 0 if the entity has no movement
+    Location start_pos;
+    Location end_pos;
+    float progress = -1;
+    Location prev_start_pos;
+    Location prev_end_pos;
+    float prev_progress = -1;
+    bool marked = false; //is a target
+    float work_progress = 0; //chop or build, 0 .. 100
+    bool blueprint = false; //construction not built yet
+    int held = 0; //woods in its storage
+    int capacity = 0;
+    TaskType task = TaskType::EMPTY;
+};
+
+//the world as the UI sees it. the simulation thread fills one after its ticks and
+//hands it over through a TripleBuffer, so drawing never reads live components
+struct RenderSnapshot {
+    int tick = 0;
+    std::chrono::steady_clock::time_point published;
+    std::vector<RenderItem> items; //woodpacks are not items, they are in dropped
+    std::vector<std::pair<Location, int>> dropped; //marked wood stacks on the ground
+};
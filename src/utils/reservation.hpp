@@ -0,0 +1,99 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "../components/component.hpp"
+
+#define RESERVATION_PURGE_TICK 64
+
+//space-time reservation table used by cooperative path finding
+//an agent reserves (tile, tick) pairs along its planned route,
+//other planners treat those pairs as blocked and route around them
+class ReservationTable {
+    //one key per (tile, tick), tick is absolute
+    static std::int64_t key(const Location& loc, int tick) {
+        return (static_cast<std::int64_t>(tick) << 32)
+            | (static_cast<std::uint32_t>(loc.x) << 16)
+            | static_cast<std::uint16_t>(loc.y);
+    }
+
+    std::unordered_map<std::int64_t, Entity> table_;
+    std::unordered_map<Entity, std::vector<std::pair<Location, int>>> owned_;
+    std::unordered_map<Entity, int> reserved_until_;
+    int now_ = 0;
+
+public:
+    int now() const { return now_; }
+
+    //called once per world tick
+    void advance() {
+        ++now_;
+        if (now_ % RESERVATION_PURGE_TICK == 0)
+            purge();
+    }
+
+    //free for this entity during [from, to)
+    bool is_free(const Location& loc, int from, int to, Entity self) const {
+        for (int t = from; t < to; ++t) {
+            auto it = table_.find(key(loc, t));
+            if (it != table_.end() && it->second != self)
+                return false;
+        }
+        return true;
+    }
+
+    //reserve [from, to), a pair already held by another agent is left to it
+    void reserve(Entity entity, const Location& loc, int from, int to) {
+        auto& owned = owned_[entity];
+        for (int t = std::max(from, now_); t < to; ++t) {
+            auto result = table_.emplace(key(loc, t), entity);
+            if (result.second)
+                owned.emplace_back(loc, t);
+        }
+        auto& until = reserved_until_[entity];
+        until = std::max(until, to);
+    }
+
+    void release(Entity entity) {
+        auto it = owned_.find(entity);
+        if (it != owned_.end()) {
+            for (auto& [loc, t] : it->second) {
+                auto slot = table_.find(key(loc, t));
+                if (slot != table_.end() && slot->second == entity)
+                    table_.erase(slot);
+            }
+            owned_.erase(it);
+        }
+        reserved_until_.erase(entity);
+    }
+
+    //last tick covered by reservations of this entity, now() if none
+    int reserved_until(Entity entity) const {
+        auto it = reserved_until_.find(entity);
+        return it == reserved_until_.end() ? now_ : it->second;
+    }
+
+    size_t size() const { return table_.size(); }
+
+private:
+    //drop reservations that are already in the past
+    void purge() {
+        for (auto it = owned_.begin(); it != owned_.end();) {
+            auto& owned = it->second;
+            owned.erase(std::remove_if(owned.begin(), owned.end(), [this](const std::pair<Location, int>& slot) {
+                if (slot.second >= now_)
+                    return false;
+                table_.erase(key(slot.first, slot.second));
+                return true;
+            }), owned.end());
+            if (owned.empty()) {
+                reserved_until_.erase(it->first);
+                it = owned_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
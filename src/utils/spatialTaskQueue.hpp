@@ -0,0 +1,155 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cstdlib>
+#include <cassert>
+#include "../components/component.hpp"
+
+//side of one bucket in tiles
+#define TASK_BUCKET_SIZE 8
+
+//open tasks grouped in tiers (one per work type), and inside a tier by a coarse grid of buckets.
+//insert and remove are O(1) (swap with the last one in the bucket);
+//nearest() searches ring by ring around the asking cell and stops as soon as no
+//further ring can hold a better task, so it does not depend on the total number of tasks
+class SpatialTaskQueue {
+public:
+    using Slot = int;
+
+private:
+    struct Tier {
+        int key;
+        int max_priority = 1; //for the ring bound
+        int count = 0;
+        std::vector<std::vector<Slot>> buckets;
+    };
+
+    struct Where {
+        bool queued = false;
+        Location loc;
+        int priority = 0;
+        int tier = 0;
+        int bucket = -1;
+        int index = -1; //position inside the bucket
+    };
+
+    int map_size_;
+    int width_; //buckets per row
+    std::vector<Tier> tiers_; //by key
+    std::vector<Where> where_; //by slot
+    int size_ = 0;
+
+    int bucket_of(const Location& loc) const {
+        int bx = std::clamp(loc.x, 0, map_size_ - 1) / TASK_BUCKET_SIZE;
+        int by = std::clamp(loc.y, 0, map_size_ - 1) / TASK_BUCKET_SIZE;
+        return bx * width_ + by;
+    }
+
+    Tier& tier(int key) {
+        assert(key >= 0 && "Invalid tier.");
+        while (static_cast<int>(tiers_.size()) <= key) {
+            Tier t;
+            t.key = static_cast<int>(tiers_.size());
+            t.buckets.resize(width_ * width_);
+            tiers_.push_back(std::move(t));
+        }
+        return tiers_[key];
+    }
+
+    //squared distance over priority, lower is better (same score the assignment uses)
+    static double score(const Location& from, const Location& to, int priority) {
+        double dx = to.x - from.x;
+        double dy = to.y - from.y;
+        return (dx * dx + dy * dy) / std::max(priority, 1);
+    }
+
+public:
+    SpatialTaskQueue(int map_size) :
+        map_size_(map_size),
+        width_((map_size + TASK_BUCKET_SIZE - 1) / TASK_BUCKET_SIZE) {}
+
+    void insert(Slot slot, const Location& loc, int priority, int tier_key) {
+        if (slot >= static_cast<int>(where_.size()))
+            where_.resize(slot + 1);
+        auto& w = where_[slot];
+        assert(!w.queued && "Task already in spatial queue.");
+        auto& t = tier(tier_key);
+        auto& bucket = t.buckets[bucket_of(loc)];
+        w = Where{true, loc, priority, tier_key, bucket_of(loc), static_cast<int>(bucket.size())};
+        bucket.push_back(slot);
+        t.max_priority = std::max(t.max_priority, priority);
+        ++t.count;
+        ++size_;
+    }
+
+    void remove(Slot slot) {
+        if (!contains(slot))
+            return;
+        auto& w = where_[slot];
+        auto& t = tier(w.tier);
+        auto& bucket = t.buckets[w.bucket];
+        bucket[w.index] = bucket.back();
+        where_[bucket[w.index]].index = w.index;
+        bucket.pop_back();
+        --t.count;
+        --size_;
+        w.queued = false;
+    }
+
+    bool contains(Slot slot) const {
+        return slot >= 0 && slot < static_cast<int>(where_.size()) && where_[slot].queued;
+    }
+
+    int size() const {
+        return size_;
+    }
+
+    //up to k accepted tasks of the given tiers with the best score from this location, best first
+    std::vector<Slot> nearest(const Location& from, int k, const std::function<bool(Slot)>& accept,
+        const std::vector<int>& tier_keys) const {
+        std::vector<std::pair<double, Slot>> found;
+        auto worst = [&found, k]() {
+            return static_cast<int>(found.size()) < k ? std::numeric_limits<double>::max() : found.back().first;
+        };
+        int cx = std::clamp(from.x, 0, map_size_ - 1) / TASK_BUCKET_SIZE;
+        int cy = std::clamp(from.y, 0, map_size_ - 1) / TASK_BUCKET_SIZE;
+
+        for (auto key : tier_keys) {
+            if (key < 0 || key >= static_cast<int>(tiers_.size()) || tiers_[key].count == 0)
+                continue;
+            auto& t = tiers_[key];
+            for (int ring = 0; ring < width_; ++ring) {
+                //every tile in this ring is at least this far away along one axis
+                double gap = ring == 0 ? 0 : (ring - 1) * TASK_BUCKET_SIZE + 1;
+                if (gap * gap / t.max_priority > worst())
+                    break;
+                for (int bx = cx - ring; bx <= cx + ring; ++bx) {
+                    for (int by = cy - ring; by <= cy + ring; ++by) {
+                        //only the border of the square is new
+                        if (std::abs(bx - cx) != ring && std::abs(by - cy) != ring)
+                            continue;
+                        if (bx < 0 || bx >= width_ || by < 0 || by >= width_)
+                            continue;
+                        for (auto slot : t.buckets[bx * width_ + by]) {
+                            double s = score(from, where_[slot].loc, where_[slot].priority);
+                            if (s >= worst() || !accept(slot))
+                                continue;
+                            auto pos = std::upper_bound(found.begin(), found.end(), std::make_pair(s, slot));
+                            found.insert(pos, {s, slot});
+                            if (static_cast<int>(found.size()) > k)
+                                found.pop_back();
+                        }
+                    }
+                }
+            }
+        }
+
+        std::vector<Slot> result;
+        for (auto& f : found)
+            result.push_back(f.second);
+        return result;
+    }
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <unordered_map>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include "../components/componentManager.hpp"
+
+//storage tiles grouped into zones (one per storage area), with running totals per zone.
+//wood is the only resource, so a zone keeps one count of contents, capacity and reserved wood.
+//each zone indexes its tiles that still have room and its tiles with unreserved wood, so
+//finding where to drop or take wood costs O(zones + log tiles), whatever the zone size.
+//all changes to a storage tile's contents go through deposit / withdraw to keep totals right
+class StockpileManager {
+    struct Tile {
+        int zone;
+        int reserved = 0; //promised to a delivery, not picked up yet
+    };
+
+    struct Zone {
+        Location lo, hi; //bounding box
+        int amount = 0;
+        int capacity = 0;
+        int reserved = 0;
+        std::set<Entity> free_tiles; //amount < capacity
+        std::set<Entity> stocked_tiles; //amount > reserved
+    };
+
+    ComponentManager& component_manager_;
+    std::vector<Zone> zones_;
+    std::unordered_map<Entity, Tile> tiles_;
+    std::unordered_map<Location, Entity> tile_at_;
+
+    StorageComponent& storage(Entity tile) {
+        return component_manager_.get_component<StorageComponent>(tile);
+    }
+
+    //put the tile into the indices its counts say it belongs to
+    void index(Entity tile) {
+        auto& t = tiles_.at(tile);
+        auto& z = zones_[t.zone];
+        auto& s = storage(tile);
+        if (s.current_storage < s.storage_capacity) z.free_tiles.insert(tile); else z.free_tiles.erase(tile);
+        if (s.current_storage > t.reserved) z.stocked_tiles.insert(tile); else z.stocked_tiles.erase(tile);
+    }
+
+    static int distance(const Location& from, const Zone& z) {
+        int dx = std::max({z.lo.x - from.x, 0, from.x - z.hi.x});
+        int dy = std::max({z.lo.y - from.y, 0, from.y - z.hi.y});
+        return dx + dy;
+    }
+
+    int find_zone(const Location& loc) const {
+        for (int i = 0; i < static_cast<int>(zones_.size()); ++i) {
+            auto& z = zones_[i];
+            if (loc.x >= z.lo.x && loc.x <= z.hi.x && loc.y >= z.lo.y && loc.y <= z.hi.y)
+                return i;
+        }
+        return -1;
+    }
+
+public:
+    StockpileManager(ComponentManager& component_manager) : component_manager_(component_manager) {}
+
+    //a storage area the player marked, its tiles join it when they are created
+    int add_zone(Location start, Location end) {
+        Zone z;
+        z.lo = Location{std::min(start.x, end.x), std::min(start.y, end.y)};
+        z.hi = Location{std::max(start.x, end.x), std::max(start.y, end.y)};
+        zones_.push_back(z);
+        return static_cast<int>(zones_.size()) - 1;
+    }
+
+    //tile outside any marked area joins a neighbouring tile's zone, or starts its own
+    void add_tile(Entity tile, const Location& loc) {
+        if (tiles_.count(tile))
+            return;
+        int zone = find_zone(loc);
+        for (auto& dir : directions) {
+            if (zone != -1)
+                break;
+            auto it = tile_at_.find(Location{loc.x + dir.first, loc.y + dir.second});
+            if (it != tile_at_.end())
+                zone = tiles_.at(it->second).zone;
+        }
+        if (zone == -1)
+            zone = add_zone(loc, loc);
+        auto& z = zones_[zone];
+        z.lo = Location{std::min(z.lo.x, loc.x), std::min(z.lo.y, loc.y)};
+        z.hi = Location{std::max(z.hi.x, loc.x), std::max(z.hi.y, loc.y)};
+        tiles_[tile] = Tile{zone};
+        tile_at_[loc] = tile;
+        z.amount += storage(tile).current_storage;
+        z.capacity += storage(tile).storage_capacity;
+        index(tile);
+    }
+
+    //after loading, zones are rebuilt from the storage tiles
+    void rebuild(const std::vector<std::pair<Entity, Location>>& tiles) {
+        zones_.clear();
+        tiles_.clear();
+        tile_at_.clear();
+        for (auto& [tile, loc] : tiles)
+            add_tile(tile, loc);
+    }
+
+    bool contains(Entity tile) const {
+        return tiles_.count(tile) != 0;
+    }
+
+    void deposit(Entity tile, int amount) {
+        auto& s = storage(tile);
+        s.current_storage += amount;
+        zones_[tiles_.at(tile).zone].amount += amount;
+        index(tile);
+    }
+
+    //returns what was actually taken
+    int withdraw(Entity tile, int amount) {
+        auto& s = storage(tile);
+        amount = std::min(amount, s.current_storage);
+        s.current_storage -= amount;
+        zones_[tiles_.at(tile).zone].amount -= amount;
+        index(tile);
+        return amount;
+    }
+
+    //delta > 0 promises wood on the tile to a delivery, delta < 0 gives it back or marks it picked
+    void reserve(Entity tile, int delta) {
+        auto& t = tiles_.at(tile);
+        t.reserved += delta;
+        zones_[t.zone].reserved += delta;
+        index(tile);
+    }
+
+    int reserved(Entity tile) const {
+        auto it = tiles_.find(tile);
+        return it == tiles_.end() ? 0 : it->second.reserved;
+    }
+
+    //tile with room left in the nearest zone that has room, -1 if all are full
+    Entity find_drop(const Location& from) const {
+        const Zone* best = nullptr;
+        for (auto& z : zones_)
+            if (!z.free_tiles.empty() && (!best || distance(from, z) < distance(from, *best)))
+                best = &z;
+        return best ? *best->free_tiles.begin() : -1;
+    }
+
+    //tile with unreserved wood in the nearest zone that has some, -1 if none.
+    //amount is cut down to what that tile can give
+    Entity find_stock(const Location& from, int& amount) {
+        const Zone* best = nullptr;
+        for (auto& z : zones_)
+            if (!z.stocked_tiles.empty() && (!best || distance(from, z) < distance(from, *best)))
+                best = &z;
+        if (!best)
+            return -1;
+        Entity tile = *best->stocked_tiles.begin();
+        amount = std::min(amount, storage(tile).current_storage - tiles_.at(tile).reserved);
+        return tile;
+    }
+
+    bool has_room(Entity tile) {
+        return contains(tile) && storage(tile).current_storage < storage(tile).storage_capacity;
+    }
+
+    void print_stats() const {
+        int amount = 0, capacity = 0, reserved = 0;
+        for (auto& z : zones_) {
+            amount += z.amount;
+            capacity += z.capacity;
+            reserved += z.reserved;
+        }
+        std::cout << "stats: " << zones_.size() << " stockpile zones, " << tiles_.size() << " tiles, "
+                  << amount << " / " << capacity << " woods stored, " << reserved << " reserved" << std::endl;
+    }
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <unordered_set>
+#include "../components/component.hpp"
+
+//full re-scan of all targets in debug builds, catches targets whose event was never sent
+#define TARGET_AUDIT_TICK 300
+
+//why a target needs to be looked at again
+enum class TargetEvent {
+    TREE_MARKED,
+    WOOD_DROPPED,
+    BLUEPRINT_PLACED,
+    BLUEPRINT_ALLOCATED,
+    STORAGE_RAISED,
+    TASK_RELEASED, //its task was dropped or given up, target may need a new one
+    RELOADED,
+    COUNT
+};
+
+//targets changed since TaskSystem last looked, filled by the systems that change them.
+//TaskSystem only creates tasks for these instead of walking every target each tick
+class TargetEvents {
+    std::vector<Entity> dirty_;
+    std::unordered_set<Entity> pending_;
+    long long counts_[static_cast<int>(TargetEvent::COUNT)] = {};
+
+public:
+    void push(Entity target, TargetEvent event) {
+        ++counts_[static_cast<int>(event)];
+        if (pending_.insert(target).second)
+            dirty_.push_back(target);
+    }
+
+    //take all dirty targets, in the order they were first pushed
+    Entities drain() {
+        Entities dirty;
+        dirty.swap(dirty_);
+        pending_.clear();
+        return dirty;
+    }
+
+    bool is_dirty(Entity target) const {
+        return pending_.count(target) != 0;
+    }
+
+    size_t size() const {
+        return dirty_.size();
+    }
+
+    long long count(TargetEvent event) const {
+        return counts_[static_cast<int>(event)];
+    }
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cassert>
+#include "../components/component.hpp"
+#include "spatialTaskQueue.hpp"
+
+//every task lives once in a slot map, waiting in queue or in progress is a state of the task.
+//tasks can be found by id, by target entity and by actor without scanning,
+//queued tasks also by work type and place
+class TaskRegistry {
+public:
+    enum class State { QUEUED, IN_PROGRESS };
+    using Slot = int;
+    static constexpr Slot NO_SLOT = -1;
+
+private:
+    struct Entry {
+        Task task;
+        State state = State::QUEUED;
+        bool in_use = false;
+        int list_pos = -1; //position in queued_ or in_progress_
+        Slot next_free = NO_SLOT;
+    };
+
+    std::vector<Entry> slots_;
+    Slot free_head_ = NO_SLOT;
+    std::vector<Slot> queued_;
+    std::vector<Slot> in_progress_;
+    std::unordered_map<int, Slot> by_id_;
+    std::unordered_map<Entity, std::vector<Slot>> by_target_;
+    std::unordered_map<Entity, std::vector<Slot>> by_actor_;
+    SpatialTaskQueue open_;
+    inline static const std::vector<Slot> none_;
+
+    std::vector<Slot>& list(State state) {
+        return state == State::QUEUED ? queued_ : in_progress_;
+    }
+
+    void list_add(Slot slot) {
+        if (slots_[slot].state == State::QUEUED)
+            open_.insert(slot, slots_[slot].task.target_locations[0], slots_[slot].task.priority, slots_[slot].task.type);
+        auto& l = list(slots_[slot].state);
+        slots_[slot].list_pos = static_cast<int>(l.size());
+        l.push_back(slot);
+    }
+
+    //swap with the last one, so removal is O(1)
+    void list_remove(Slot slot) {
+        open_.remove(slot);
+        auto& l = list(slots_[slot].state);
+        int pos = slots_[slot].list_pos;
+        l[pos] = l.back();
+        slots_[l[pos]].list_pos = pos;
+        l.pop_back();
+        slots_[slot].list_pos = -1;
+    }
+
+    static void index_add(std::unordered_map<Entity, std::vector<Slot>>& index, Entity key, Slot slot) {
+        if (key != -1)
+            index[key].push_back(slot);
+    }
+
+    static void index_remove(std::unordered_map<Entity, std::vector<Slot>>& index, Entity key, Slot slot) {
+        auto it = index.find(key);
+        if (it == index.end())
+            return;
+        auto& slots = it->second;
+        auto pos = std::find(slots.begin(), slots.end(), slot);
+        if (pos != slots.end()) {
+            *pos = slots.back();
+            slots.pop_back();
+        }
+        if (slots.empty())
+            index.erase(it);
+    }
+
+    const Entry& entry(Slot slot) const {
+        assert(slot >= 0 && slot < static_cast<int>(slots_.size()) && slots_[slot].in_use && "Invalid task slot.");
+        return slots_[slot];
+    }
+
+    Entry& entry(Slot slot) {
+        assert(slot >= 0 && slot < static_cast<int>(slots_.size()) && slots_[slot].in_use && "Invalid task slot.");
+        return slots_[slot];
+    }
+
+public:
+    TaskRegistry(int map_size) : open_(map_size) {}
+
+    Slot add(const Task& task, State state) {
+        assert(by_id_.find(task.id) == by_id_.end() && "Task id already registered.");
+        Slot slot;
+        if (free_head_ != NO_SLOT) {
+            slot = free_head_;
+            free_head_ = slots_[slot].next_free;
+        } else {
+            slot = static_cast<int>(slots_.size());
+            slots_.emplace_back();
+        }
+        auto& e = slots_[slot];
+        e.task = task;
+        e.state = state;
+        e.in_use = true;
+        list_add(slot);
+        by_id_[task.id] = slot;
+        index_add(by_target_, task.target_action.target_entity, slot);
+        index_add(by_actor_, task.actor, slot);
+        return slot;
+    }
+
+    void remove(Slot slot) {
+        auto& e = entry(slot);
+        list_remove(slot);
+        by_id_.erase(e.task.id);
+        index_remove(by_target_, e.task.target_action.target_entity, slot);
+        index_remove(by_actor_, e.task.actor, slot);
+        e.in_use = false;
+        e.next_free = free_head_;
+        free_head_ = slot;
+    }
+
+    Slot find(int id) const {
+        auto it = by_id_.find(id);
+        return it == by_id_.end() ? NO_SLOT : it->second;
+    }
+
+    //tasks are read only from outside, actor and state change through the setters to keep indices right
+    const Task& get(Slot slot) const {
+        return entry(slot).task;
+    }
+
+    State state(Slot slot) const {
+        return entry(slot).state;
+    }
+
+    void set_state(Slot slot, State state) {
+        if (entry(slot).state == state)
+            return;
+        list_remove(slot);
+        slots_[slot].state = state;
+        list_add(slot);
+    }
+
+    void set_actor(Slot slot, Entity actor) {
+        auto& e = entry(slot);
+        if (e.task.actor == actor)
+            return;
+        index_remove(by_actor_, e.task.actor, slot);
+        e.task.actor = actor;
+        index_add(by_actor_, actor, slot);
+    }
+
+    const std::vector<Slot>& by_target(Entity target) const {
+        auto it = by_target_.find(target);
+        return it == by_target_.end() ? none_ : it->second;
+    }
+
+    const std::vector<Slot>& by_actor(Entity actor) const {
+        auto it = by_actor_.find(actor);
+        return it == by_actor_.end() ? none_ : it->second;
+    }
+
+    bool has_target(Entity target, State state) const {
+        for (auto slot : by_target(target))
+            if (slots_[slot].state == state)
+                return true;
+        return false;
+    }
+
+    //up to k queued tasks of the given types with the best distance / priority score from a location, best first
+    std::vector<Slot> nearest_queued(const Location& from, int k, const std::function<bool(Slot)>& accept,
+        const std::vector<int>& types) const {
+        return open_.nearest(from, k, accept, types);
+    }
+
+    const std::vector<Slot>& queued() const { return queued_; }
+    const std::vector<Slot>& in_progress() const { return in_progress_; }
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include "../components/component.hpp"
+
+//slots per level, a power of two
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+//4 levels of 64 slots reach 2^24 ticks ahead (over 6 days at 30 ticks per second)
+#define TIMER_WHEEL_LEVELS 4
+
+//timers that belong to the world rather than to an entity
+const Entity WORLD_TIMER = -1;
+
+//what a timer is for, one timer per (entity, tag)
+enum class TimerTag {
+    TARGET_AUDIT,
+    ACTION_DONE, //a fixed duration action (chop, build) is done
+    COUNT
+};
+
+//hierarchical timing wheel. level 0 has one slot per tick, each level above covers 64 times
+//the span of the one below and is cascaded down when level 0 wraps. schedule, cancel and firing
+//are O(1), and nothing is touched for timers that are not due yet
+class TimerWheel {
+    using Key = std::uint64_t;
+
+    struct Timer {
+        Entity entity;
+        TimerTag tag;
+        int start;
+        int due;
+        int generation; //slot entries of an older schedule are skipped
+    };
+
+    struct Entry {
+        Key key;
+        int generation;
+    };
+
+    std::array<std::array<std::vector<Entry>, TIMER_WHEEL_SLOTS>, TIMER_WHEEL_LEVELS> slots_;
+    std::unordered_map<Key, Timer> timers_;
+    std::array<Entities, static_cast<int>(TimerTag::COUNT)> fired_;
+    int now_ = 0;
+    int generation_ = 0;
+
+    //the entity's bits as unsigned, so WORLD_TIMER (-1) gets a key of its own without shifting a negative
+    static Key key(Entity entity, TimerTag tag) {
+        return (static_cast<Key>(static_cast<std::uint32_t>(entity)) << 8) | static_cast<Key>(tag);
+    }
+
+    void place(Key k, const Timer& timer) {
+        int delta = timer.due - now_;
+        int level = 0;
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1 << (TIMER_WHEEL_BITS * (level + 1))))
+            ++level;
+        int slot = (timer.due >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+        slots_[level][slot].push_back(Entry{k, timer.generation});
+    }
+
+    bool is_live(const Entry& entry) const {
+        auto it = timers_.find(entry.key);
+        return it != timers_.end() && it->second.generation == entry.generation;
+    }
+
+    //move the timers of this level's current slot one level down (or further)
+    void cascade(int level) {
+        int slot = (now_ >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+        std::vector<Entry> entries;
+        entries.swap(slots_[level][slot]);
+        for (auto& entry : entries)
+            if (is_live(entry))
+                place(entry.key, timers_.at(entry.key));
+    }
+
+public:
+    int now() const {
+        return now_;
+    }
+
+    //true on one tick in every period, spread by entity so each tick takes about 1 / period of them.
+    //for work that may be done round-robin instead of for everyone every tick
+    bool on_turn(Entity entity, int period) const {
+        if (period <= 1)
+            return true;
+        return ((now_ + entity) % period + period) % period == 0;
+    }
+
+    //fire after delay ticks (at least 1), an existing timer of this entity and tag is replaced
+    void schedule(Entity entity, TimerTag tag, int delay) {
+        Key k = key(entity, tag);
+        Timer timer{entity, tag, now_, now_ + std::max(delay, 1), ++generation_};
+        timers_[k] = timer;
+        place(k, timer);
+    }
+
+    //the slot entry stays behind and is skipped when its slot comes up
+    void cancel(Entity entity, TimerTag tag) {
+        timers_.erase(key(entity, tag));
+    }
+
+    bool is_scheduled(Entity entity, TimerTag tag) const {
+        return timers_.count(key(entity, tag)) != 0;
+    }
+
+    //share of the timer's span already passed, 0 if it is not scheduled
+    float elapsed(Entity entity, TimerTag tag) const {
+        auto it = timers_.find(key(entity, tag));
+        if (it == timers_.end())
+            return 0;
+        auto& timer = it->second;
+        return static_cast<float>(now_ - timer.start) / (timer.due - timer.start);
+    }
+
+    //called once per world tick, timers due now are moved to the fired lists
+    void advance() {
+        for (auto& fired : fired_)
+            fired.clear();
+        ++now_;
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+            if ((now_ & ((1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0)
+                break;
+            cascade(level);
+        }
+        std::vector<Entry> entries;
+        entries.swap(slots_[0][now_ & (TIMER_WHEEL_SLOTS - 1)]);
+        for (auto& entry : entries) {
+            if (!is_live(entry))
+                continue;
+            auto timer = timers_.at(entry.key);
+            timers_.erase(entry.key);
+            fired_[static_cast<int>(timer.tag)].push_back(timer.entity);
+        }
+    }
+
+    //entities whose timer of this tag fired on the current tick
+    const Entities& fired(TimerTag tag) const {
+        return fired_[static_cast<int>(tag)];
+    }
+
+    size_t size() const {
+        return timers_.size();
+    }
+
+    //entities with a pending timer of this tag
+    Entities scheduled(TimerTag tag) const {
+        Entities entities;
+        for (auto& pair : timers_)
+            if (pair.second.tag == tag)
+                entities.push_back(pair.second.entity);
+        return entities;
+    }
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+//one writer thread hands whole values to one reader thread without locks.
+//the writer fills back(), publish() swaps it with the middle buffer, the reader's
+//update() swaps the middle buffer with front() if something new was published.
+//neither side ever waits, and the reader only sees values that were completely written
+template<typename T>
+class TripleBuffer {
+    static constexpr int INDEX_MASK = 3;
+    static constexpr int FRESH = 4; //middle holds a value the reader hasn't taken yet
+
+    std::array<T, 3> buffers_;
+    std::atomic<int> middle_{1};
+    int back_ = 0; //writer only
+    int front_ = 2; //reader only
+
+public:
+    //writer side
+    T& back() {
+        return buffers_[back_];
+    }
+
+    void publish() {
+        back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    //reader side, true if front() changed
+    bool update() {
+        if (!(middle_.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& front() const {
+        return buffers_[front_];
+    }
+};
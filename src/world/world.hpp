@@ -1,18 +1,32 @@
 #pragma once
 #include <memory>
-#include <random>
+#include <fstream>
 #include "../entities/entity.hpp"
 #include "../utils/path.hpp"
+#include "../utils/renderSnapshot.hpp"
+#include "../utils/commandQueue.hpp"
 #include <SFML/Graphics.hpp>
 #include "../system/actionsystem.hpp"
 #include "../system/taskSystem.hpp"
 #include "../system/createsystem.hpp"
+#include "../system/systemScheduler.hpp"
 
 #define MAP_SIZE 50
 #define MAX_DIST MAP_SIZE*MAP_SIZE
+//simulation ticks per second, a tick is always 1 / FRAMERATE seconds of game time
 #define FRAMERATE 30
 #define TILE_SIZE 32
 #define TREE_GEN_TICK 500
+#define STATS_TICK 1800
+//landmark tables are checked for changes twice a second, not every tick
+#define LANDMARK_REFRESH_PERIOD 15
+//what one run of a system may take before the stats count it as over budget, a tick is 33333 us
+#define TICK_BUDGET_US 500
+#define TASK_BUDGET_US 1000
+#define ASSIGN_BUDGET_US 2000
+#define STORAGE_BUDGET_US 500
+#define LANDMARK_BUDGET_US 1000
+#define ACTION_BUDGET_US 4000
 class World {
     friend class UI;
 public:
@@ -33,44 +47,52 @@ public:
           component_manager_(),
           router_(component_manager_, entity_manager_, MAP_SIZE),
           create_system_(component_manager_, entity_manager_, router_, TILE_SIZE),
-          action_system_(component_manager_, entity_manager_, router_, MAP_SIZE, FRAMERATE),
-          task_system_(component_manager_, entity_manager_, router_),
-          rng(static_cast<unsigned>(std::time(nullptr))), 
-          dist(0, MAP_SIZE - 1) {
-        timer_ = 0;
-        std::cout << "starting a new world" << std::endl;
+          action_system_(component_manager_, entity_manager_, router_, jobs_, MAP_SIZE, FRAMERATE),
+          task_system_(component_manager_, entity_manager_, router_, MAP_SIZE),
+          scheduler_(jobs_) {
+        std::cout << "starting a new world, seed " << router_.get_random().seed() << std::endl;
         register_all_components();
+        register_systems();
         init_world();
     }
 
     void update_world() {
-        tick();
-        create_system_.update();
-        task_system_.update();
-        action_system_.update();
+        apply_commands();
+        scheduler_.run();
     }
     
-    // Functions operated by USER (maybe by UI)
-    bool mark_tree(bool mark);
-    bool make_storage_area(Location start, Location end);
-    bool set_door_blueprint(Location pos);
-    bool set_wall_blueprint(Location pos);
+    // Player commands, any thread may push them; they are applied at the start of the next tick
+    void push_command(const PlayerCommand& command) {commands_.push(command);}
+    CommandQueue<CommandResult>& get_command_results() {return command_results_;}
 
     // More methods related to entity
     void generate_random_entity(int count, EntityType type);
     void set_speed(Entity entity, int speed);
+    bool set_work_priority(Entity character, TaskType type, int priority);
     Entities get_all_entities() {return router_.get_all_entities();}
     // Related to UI
     int get_world_width() {return MAP_SIZE;}
     int get_world_height() {return MAP_SIZE;}
     int get_woods_at_loc(Location loc);
+    void fill_snapshot(RenderSnapshot& snapshot);
     // About world save and load
     void save_world();
     void load_world();
 
 private:
+    // Functions operated by USER, applied from the command queue
+    void apply_commands();
+    bool apply_command(const PlayerCommand& command);
+    bool mark_tree(bool mark);
+    bool make_storage_area(Location start, Location end);
+    bool set_door_blueprint(Location pos);
+    bool set_wall_blueprint(Location pos);
+    void select_entities_in_area(Location start, Location end);
+    void unselect_all_entities();
+
     // Starter function run every time
     void register_all_components();
+    void register_systems();
     void init_world();
     void tick();
 
@@ -78,19 +100,88 @@ private:
     std::vector<Entity> characters_;
     std::vector<Entity> animals_;
 
-    // Random seed
-    std::mt19937 rng;
-    std::uniform_int_distribution<int> dist;
+    // Jobs for parallel work, and the systems run on them each tick
+    JobSystem jobs_;
+    SystemScheduler scheduler_;
 
-    // Timer for tree generation
-    int timer_;
+    // Commands from the UI, and their results going back
+    CommandQueue<PlayerCommand> commands_;
+    CommandQueue<CommandResult> command_results_;
+
+    // Ticks since world started, for stats and the random streams
+    int total_ticks_ = 0;
+    void print_stats();
 };
 void World::tick() {
-    ++timer_;
-    if (timer_ >= TREE_GEN_TICK) {
-        generate_random_entity(1, EntityType::TREE);
-        timer_ = 0;
+    router_.get_reservations().advance();
+    router_.get_timers().advance();
+    ++total_ticks_;
+    router_.get_random().set_tick(total_ticks_);
+}
+
+void World::print_stats() {
+    float minutes = total_ticks_ / (FRAMERATE * 60.0f);
+    int hauled = action_system_.get_wood_hauled();
+    std::cout << "stats: " << hauled << " woods hauled in " << minutes << " min, "
+              << hauled / minutes << " per minute" << std::endl;
+    router_.print_search_stats();
+    action_system_.get_path_scheduler().print_stats();
+    scheduler_.print_stats();
+    //hauling cost per unit of wood: fewer trips and fewer searches per wood is better
+    int trips = action_system_.get_store_trips();
+    long long searches = router_.get_search_count() + action_system_.get_path_scheduler().get_served();
+    if (hauled > 0)
+        std::cout << "stats: " << trips << " store trips, " << static_cast<float>(hauled) / std::max(trips, 1)
+                  << " woods per trip, " << static_cast<float>(searches) / hauled << " path searches per wood" << std::endl;
+    task_system_.print_haul_stats();
+    std::cout << "stats: " << router_.get_all_entities().size() << " entities alive, "
+              << entity_manager_.awake_count() << " awake" << std::endl;
+}
+
+//the whole batch runs before any system, in the order the commands were pushed
+void World::apply_commands() {
+    commands_.drain([this](PlayerCommand& command) {
+        command_results_.push(CommandResult{command.type, apply_command(command)});
+    });
+}
+
+bool World::apply_command(const PlayerCommand& command) {
+    switch (command.type) {
+        case CommandType::SELECT_AREA:
+            select_entities_in_area(command.start, command.end);
+            return true;
+        case CommandType::UNSELECT_ALL:
+            unselect_all_entities();
+            return true;
+        case CommandType::MARK_TREES:
+            return mark_tree(true);
+        case CommandType::UNMARK_TREES:
+            return mark_tree(false);
+        case CommandType::MAKE_STORAGE:
+            return make_storage_area(command.start, command.end);
+        case CommandType::SET_DOOR:
+            return set_door_blueprint(command.start);
+        case CommandType::SET_WALL:
+            return set_wall_blueprint(command.start);
     }
+    return false;
+}
+
+void World::select_entities_in_area(Location start, Location end) {
+    int min_x = std::min(start.x, end.x);
+    int max_x = std::max(start.x, end.x);
+    int min_y = std::min(start.y, end.y);
+    int max_y = std::max(start.y, end.y);
+    for (auto& entity : router_.get_entities_with_components<RenderComponent>()) {
+        auto& loc = component_manager_.get_component<LocationComponent>(entity).loc;
+        if (loc.x >= min_x && loc.x <= max_x && loc.y >= min_y && loc.y <= max_y)
+            component_manager_.get_component<RenderComponent>(entity).is_selected = true;
+    }
+}
+
+void World::unselect_all_entities() {
+    for (auto& entity : router_.get_entities_with_components<RenderComponent>())
+        component_manager_.get_component<RenderComponent>(entity).is_selected = false;
 }
 
 bool World::mark_tree(bool mark) {
@@ -116,6 +207,8 @@ bool World::mark_tree(bool mark) {
             } 
             auto& target = component_manager_.get_component<TargetComponent>(entity);
             target.is_target = mark;
+            if (mark)
+                router_.get_target_events().push(entity, TargetEvent::TREE_MARKED);
             marked = true;
         }
     }
@@ -137,6 +230,8 @@ bool World::make_storage_area(Location start, Location end) {
         }
     }
 
+    //tiles join this zone as CreateSystem makes them
+    router_.get_stockpiles().add_zone(Location{start_x, start_y}, Location{end_x, end_y});
     for(int i = start_x; i <= end_x; ++i) {
         for(int j = start_y; j <= end_y; ++j) {
             Entity temp = entity_manager_.create_entity();
@@ -148,14 +243,95 @@ bool World::make_storage_area(Location start, Location end) {
 }
 
 
+//copy what the UI draws, called by the simulation thread after its ticks
+void World::fill_snapshot(RenderSnapshot& snapshot) {
+    snapshot.tick = total_ticks_;
+    snapshot.items.clear();
+    snapshot.dropped.clear();
+    for (auto entity : get_all_entities()) {
+        if (!component_manager_.has_component<RenderComponent>(entity))
+            continue;
+        auto& render = component_manager_.get_component<RenderComponent>(entity);
+        auto& loc = component_manager_.get_component<LocationComponent>(entity).loc;
+        if (render.entityType == EntityType::WOODPACK) {
+            if (component_manager_.has_component<ResourceComponent>(entity)
+                && component_manager_.has_component<TargetComponent>(entity)
+                && component_manager_.get_component<TargetComponent>(entity).is_target)
+                snapshot.dropped.emplace_back(loc, component_manager_.get_component<ResourceComponent>(entity).amount);
+            continue;
+        }
+        RenderItem item{};
+        item.entity = entity;
+        item.type = render.entityType;
+        item.loc = loc;
+        item.selected = render.is_selected;
+        item.progress = item.prev_progress = -1;
+        item.task = TaskType::EMPTY;
+        if (component_manager_.has_component<MovementComponent>(entity)) {
+            auto& movement = component_manager_.get_component<MovementComponent>(entity);
+            item.start_pos = movement.start_pos;
+            item.end_pos = movement.end_pos;
+            item.progress = movement.progress;
+            item.prev_start_pos = movement.prev_start_pos;
+            item.prev_end_pos = movement.prev_end_pos;
+            item.prev_progress = movement.prev_progress;
+        }
+        if (component_manager_.has_component<TargetComponent>(entity)) {
+            auto& target = component_manager_.get_component<TargetComponent>(entity);
+            item.marked = target.is_target;
+            item.work_progress = action_system_.get_progress(target);
+        }
+        if (component_manager_.has_component<StorageComponent>(entity)) {
+            auto& storage = component_manager_.get_component<StorageComponent>(entity);
+            item.held = storage.current_storage;
+            item.capacity = storage.storage_capacity;
+        }
+        if (component_manager_.has_component<ConstructionComponent>(entity))
+            item.blueprint = !component_manager_.get_component<ConstructionComponent>(entity).is_built;
+        if (component_manager_.has_component<TaskComponent>(entity))
+            item.task = component_manager_.get_component<TaskComponent>(entity).current_task.type;
+        snapshot.items.push_back(item);
+    }
+}
+
 void World::save_world() {
+    //timed actions are not saved, their progress is written to the targets and they restart
+    action_system_.pause_timed_actions();
     entity_manager_.save();
     component_manager_.save();
+    //random streams are derived from seed and tick, a loaded world draws what this one would have
+    nlohmann::json j;
+    j["seed"] = router_.get_random().seed();
+    j["tick"] = total_ticks_;
+    std::ofstream file("../saves/world.json");
+    if (file.is_open())
+        file << j.dump(4);
+    else
+        std::cerr << "Unable to open file for saving: ../saves/world.json" << std::endl;
 }
 
 void World::load_world() {
     entity_manager_.load();
     component_manager_.load();
+    std::ifstream file("../saves/world.json");
+    if (file.is_open()) {
+        nlohmann::json j;
+        file >> j;
+        router_.get_random().set_seed(j.value("seed", router_.get_random().seed()));
+        total_ticks_ = j.value("tick", 0);
+        router_.get_random().set_tick(total_ticks_);
+        std::cout << "loaded world seed " << router_.get_random().seed() << " at tick " << total_ticks_ << std::endl;
+    }
+    action_system_.drop_timed_actions();
+    router_.invalidate_collision();
+    //stockpile zones are not saved, they are rebuilt from the storage tiles
+    std::vector<std::pair<Entity, Location>> tiles;
+    for (auto& entity : router_.get_storage_areas())
+        tiles.emplace_back(entity, component_manager_.get_component<LocationComponent>(entity).loc);
+    router_.get_stockpiles().rebuild(tiles);
+    //every loaded target may need a task
+    for (auto& entity : router_.get_entities_with_components<TargetComponent>())
+        router_.get_target_events().push(entity, TargetEvent::RELOADED);
 }
 
 
@@ -164,16 +340,31 @@ void World::set_speed(Entity entity, int speed) {
     component_manager_.get_component<MovementComponent>(entity).speed = speed;
 }
 
+//priority is WORK_DISABLED or WORK_PRIORITY_HIGHEST..WORK_PRIORITY_LOWEST
+bool World::set_work_priority(Entity character, TaskType type, int priority) {
+    if (!component_manager_.has_component<WorkPriorityComponent>(character)) {
+        std::cout << "entity " << character << " has no work priorities" << std::endl;
+        return false;
+    }
+    if (priority != WORK_DISABLED && (priority < WORK_PRIORITY_HIGHEST || priority > WORK_PRIORITY_LOWEST)) {
+        std::cout << "invalid work priority " << priority << std::endl;
+        return false;
+    }
+    component_manager_.get_component<WorkPriorityComponent>(character).priority[type] = priority;
+    //obtaining resources is part of allocating them
+    if (type == TaskType::ALLOCATE)
+        component_manager_.get_component<WorkPriorityComponent>(character).priority[TaskType::OBTAIN] = priority;
+    return true;
+}
+
 int World::get_woods_at_loc(Location loc) {
     int count = 0;
     for(auto& entity : router_.get_entities_with_components<RenderComponent>()) {
         auto& type = component_manager_.get_component<RenderComponent>(entity).entityType;
         if (type == EntityType::WOODPACK) {
-            auto& tree_loc = component_manager_.get_component<LocationComponent>(entity).loc;
-            auto& resource = component_manager_.get_component<ResourceComponent>(entity);
-            if (tree_loc == loc && resource.holder == -1) {
-                ++count;
-            }
+            auto& stack_loc = component_manager_.get_component<LocationComponent>(entity).loc;
+            if (stack_loc == loc)
+                count += component_manager_.get_component<ResourceComponent>(entity).amount;
         }
     }
     return count;
@@ -191,12 +382,90 @@ void World::register_all_components() {
     component_manager_.register_component<TargetComponent>();
     component_manager_.register_component<CreateComponent>();
     component_manager_.register_component<ActionComponent>();
+    component_manager_.register_component<WorkPriorityComponent>();
+}
+
+//what each system reads and writes, the scheduler keeps this order only where they conflict
+void World::register_systems() {
+    auto& cm = component_manager_;
+    auto resources = [](std::initializer_list<int> bits) {
+        ComponentMask mask;
+        for (int bit : bits)
+            mask.set(bit);
+        return mask;
+    };
+    auto entities = resources({ENTITY_RESOURCE});
+    auto grid = resources({GRID_RESOURCE});
+    auto all_resources = resources({ENTITY_RESOURCE, GRID_RESOURCE, RESERVATION_RESOURCE, PATH_RESOURCE,
+        TARGET_EVENT_RESOURCE, STOCKPILE_RESOURCE, TIMER_RESOURCE});
+    //rebuilding the collision map reads these
+    auto grid_reads = cm.component_mask<LocationComponent, RenderComponent, ConstructionComponent,
+        MovementComponent, TargetComponent>();
+    auto map_reads = grid_reads | cm.component_mask<TaskComponent>();
+
+    //the clock: reservations, timers and random streams move to the next tick
+    scheduler_.add("tick",
+        {},
+        resources({RESERVATION_RESOURCE, TIMER_RESOURCE}),
+        [this] { tick(); },
+        {.budget_us = TICK_BUDGET_US});
+    //only the grid, so it runs next to the clock
+    scheduler_.add("landmarks",
+        grid_reads,
+        grid,
+        [this] { router_.refresh_landmarks(); },
+        {.period = LANDMARK_REFRESH_PERIOD, .budget_us = LANDMARK_BUDGET_US});
+    //a tree every TREE_GEN_TICK ticks, the first one a full period after the start
+    scheduler_.add("spawn",
+        grid_reads | resources({TIMER_RESOURCE}),
+        grid | entities | cm.component_mask<LocationComponent, CreateComponent>(),
+        [this] { generate_random_entity(1, EntityType::TREE); },
+        {.period = TREE_GEN_TICK, .offset = TREE_GEN_TICK - 1});
+    //turns CreateComponents into entities and destroys finished ones
+    scheduler_.add("create",
+        map_reads,
+        grid | entities | resources({TARGET_EVENT_RESOURCE, STOCKPILE_RESOURCE})
+            | cm.component_mask<CreateComponent, LocationComponent, RenderComponent, ResourceComponent,
+            TargetComponent, StorageComponent, ConstructionComponent, TaskComponent, ActionComponent,
+            MovementComponent, WorkPriorityComponent>(),
+        [this] { create_system_.update(); });
+    //the task system's phases are separate systems so each is timed on its own.
+    //they share the task registry and TaskComponent, so they stay in order
+    auto task_reads = map_reads | entities | cm.component_mask<ResourceComponent, StorageComponent,
+        WorkPriorityComponent, ActionComponent>();
+    auto task_writes = cm.component_mask<TaskComponent, TargetComponent, StorageComponent, ResourceComponent>();
+    scheduler_.add("task", task_reads,
+        task_writes | grid | entities | resources({TARGET_EVENT_RESOURCE, STOCKPILE_RESOURCE, TIMER_RESOURCE}),
+        [this] { task_system_.update_tasks(); },
+        {.budget_us = TASK_BUDGET_US});
+    //every tick, each on a quarter of the characters
+    scheduler_.add("assign", task_reads | resources({TIMER_RESOURCE}),
+        task_writes | resources({STOCKPILE_RESOURCE}),
+        [this] { task_system_.assign_task(); },
+        {.budget_us = ASSIGN_BUDGET_US});
+    scheduler_.add("storage", task_reads | resources({TIMER_RESOURCE}),
+        task_writes | resources({TARGET_EVENT_RESOURCE, STOCKPILE_RESOURCE}),
+        [this] { task_system_.update_storage(); },
+        {.budget_us = STORAGE_BUDGET_US});
+    scheduler_.add("action",
+        map_reads | cm.component_mask<ResourceComponent, StorageComponent>(),
+        all_resources | cm.component_mask<ActionComponent, MovementComponent, LocationComponent, TargetComponent,
+            StorageComponent, ResourceComponent, ConstructionComponent, CreateComponent, TaskComponent>(),
+        [this] { action_system_.update(); },
+        {.budget_us = ACTION_BUDGET_US});
+    //reads every part for the stats, last so it sees the whole tick
+    scheduler_.add("stats",
+        all_resources,
+        {},
+        [this] { print_stats(); },
+        {.period = STATS_TICK, .offset = STATS_TICK - 1});
 }
 
 void World::generate_random_entity(int count, EntityType type) {
+    auto random = router_.get_random().stream(RandomStream::SPAWN, static_cast<int>(type));
     while (count > 0) {
-        int x = dist(rng);
-        int y = dist(rng);
+        int x = random.uniform(0, MAP_SIZE - 1);
+        int y = random.uniform(0, MAP_SIZE - 1);
         Location loc{x, y};
         std::cout << "try create entity type: " << type << " at (" << x << ", " << y << ")" << std::endl;
         if (router_.is_valid_position(loc)) {